@@ -0,0 +1,377 @@
+#include "matrix.h"
+#include "gemm.h"
+#include "distribution.h"
+#include "trace.h"
+#include <mpi.h>
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Benchmark harness: every selected kernel on every shape and thread count,
+// with warm-up runs and repetitions, reported as JSON or CSV and optionally
+// compared against a stored baseline. Rank counts are swept by launching it
+// under mpirun at each count (make bench); kernels that are not distributed
+// only run when there is a single rank. Nothing is verified here, the tests
+// do that, so no reference product shares the process or the caches.
+
+struct Shape
+{
+    string name;
+    int m, n, p;
+};
+
+using bench_fn = function<vector<double>(const vector<double> &, const vector<double> &, int, int, int, int, int)>;
+
+struct Kernel
+{
+    string name;
+    bool distributed; // runs at every rank count, otherwise only with one rank
+    bool threaded;    // swept over --threads, otherwise run with one thread
+    bench_fn run;
+};
+
+struct Result
+{
+    string kernel, shape;
+    int m, n, p, threads, ranks, reps;
+    double median, p95, min, gflops, peak_pct;
+};
+
+struct Options
+{
+    int size = 1000, warmup = 1, reps = 5;
+    vector<int> threads = {omp_get_max_threads()};
+    vector<Shape> shapes;
+    vector<string> kernels; // name prefixes, empty for all
+    string format = "json", output, baseline, trace;
+    double tolerance = 0.10;
+};
+
+using local_fn = vector<double> (*)(const vector<double> &, const vector<double> &, int, int, int);
+
+static Kernel local_kernel(const string &name, bool threaded, local_fn f)
+{
+    return {name, false, threaded, [f](const vector<double> &A, const vector<double> &B, int m, int n, int p, int, int)
+            { return f(A, B, m, n, p); }};
+}
+
+// multiply_omp into a freshly allocated, untouched C, so the run itself
+// first-touches it: in NUMA mode with the ownership of the compute loop, off
+// it by static row blocks. The mode stays set for the next run, so pinning
+// happens in the warm-up; C is dropped.
+static Kernel numa_kernel(const string &name, bool numa, bool replicate_B)
+{
+    return {name, false, true, [=](const vector<double> &A, const vector<double> &B, int m, int n, int p, int, int)
+            {
+                unique_ptr<double[]> C(new double[(long)m * p]);
+                set_numa_mode(numa, replicate_B);
+                multiply_omp<double>({A.data(), m, n, n}, {B.data(), n, p, p}, {C.get(), m, p, p});
+                return vector<double>();
+            }};
+}
+
+// The NUMA kernels come last: they leave the process in NUMA mode off
+static vector<Kernel> all_kernels()
+{
+    return {
+        local_kernel("multiply", false, multiply<double>),
+        local_kernel("strassen", false, strassen<double>),
+        local_kernel("multiply_omp", true, multiply_omp<double>),
+        local_kernel("strassen_omp", true, strassen_omp<double>),
+        {"multiply_mpi", true, false, multiply_mpi<double>},
+        {"multiply_mpi_pipelined", true, false, multiply_mpi_pipelined<double>},
+        {"multiply_summa", true, false, multiply_summa<double>},
+        {"multiply_summa_25d", true, false, multiply_summa_25d<double>},
+        {"strassen_mpi", true, false, strassen_mpi<double>},
+        {"multiply_hybrid", true, true, multiply_hybrid<double>},
+        {"multiply_hybrid_pipelined", true, true, multiply_hybrid_pipelined<double>},
+        {"multiply_hybrid_shared", true, true, multiply_hybrid_shared<double>},
+        {"multiply_summa_hybrid", true, true, multiply_summa_hybrid<double>},
+        {"multiply_summa_25d_hybrid", true, true, multiply_summa_25d_hybrid<double>},
+        {"strassen_hybrid", true, true, strassen_hybrid<double>},
+        numa_kernel("multiply_omp_numa", true, false),
+        numa_kernel("multiply_omp_numa_replicate", true, true),
+        numa_kernel("multiply_omp_numa_off", false, false),
+    };
+}
+
+// Square, its odd (non power of two) neighbour, tall-skinny and rectangular
+// shapes around --size
+static vector<Shape> default_shapes(int N)
+{
+    return {
+        {"square", N, N, N},
+        {"square_odd", N + 1, N + 1, N + 1},
+        {"tall_skinny", 8 * N, max(1, N / 8), max(1, N / 8)},
+        {"rectangular", N, 2 * N, max(1, N / 2)},
+    };
+}
+
+// Double-precision GFLOP/s of one core: FMA (2 flops) on two pipes of the
+// native SIMD width at the maximum clock. MATMUL_PEAK_GFLOPS overrides it.
+static double core_peak_gflops()
+{
+    if (const char *forced = getenv("MATMUL_PEAK_GFLOPS"))
+        return atof(forced);
+    double ghz = 0;
+    ifstream max_freq("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq");
+    if (max_freq >> ghz)
+        ghz /= 1e6;
+    ifstream cpuinfo("/proc/cpuinfo");
+    for (string line; ghz <= 0 && getline(cpuinfo, line);)
+        if (line.rfind("cpu MHz", 0) == 0)
+            ghz = atof(line.substr(line.find(':') + 1).c_str()) / 1e3;
+    return (ghz > 0 ? ghz : 2.0) * 2 * 2 * native_simd<double>::size();
+}
+
+static vector<string> split(const string &list, char sep)
+{
+    vector<string> items;
+    stringstream in(list);
+    for (string item; getline(in, item, sep);)
+        items.push_back(item);
+    return items;
+}
+
+static Options parse_options(int argc, char *argv[])
+{
+    Options opt;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (i + 1 == argc)
+            throw invalid_argument(arg + " needs a value");
+        string value = argv[++i];
+        if (arg == "--size")
+            opt.size = stoi(value);
+        else if (arg == "--warmup")
+            opt.warmup = stoi(value);
+        else if (arg == "--reps")
+            opt.reps = max(1, stoi(value));
+        else if (arg == "--threads")
+        {
+            opt.threads.clear();
+            for (const string &t : split(value, ','))
+                opt.threads.push_back(stoi(t));
+        }
+        else if (arg == "--kernels")
+            opt.kernels = split(value, ',');
+        else if (arg == "--shape")
+        {
+            vector<string> d = split(value, 'x');
+            if (d.size() != 3)
+                throw invalid_argument("--shape takes MxNxP");
+            opt.shapes.push_back({value, stoi(d[0]), stoi(d[1]), stoi(d[2])});
+        }
+        else if (arg == "--format")
+            opt.format = value;
+        else if (arg == "--output")
+            opt.output = value;
+        else if (arg == "--baseline")
+            opt.baseline = value;
+        else if (arg == "--trace")
+            opt.trace = value;
+        else if (arg == "--tolerance")
+            opt.tolerance = stod(value);
+        else
+            throw invalid_argument("unknown option " + arg);
+    }
+    if (opt.format != "json" && opt.format != "csv")
+        throw invalid_argument("--format is json or csv");
+    if (opt.shapes.empty())
+        opt.shapes = default_shapes(opt.size);
+    return opt;
+}
+
+static bool selected(const Options &opt, const string &kernel)
+{
+    if (opt.kernels.empty())
+        return true;
+    for (const string &prefix : opt.kernels)
+        if (kernel.rfind(prefix, 0) == 0)
+            return true;
+    return false;
+}
+
+// Warm-up runs, then `reps` timed ones; a run takes as long as its slowest rank
+static Result measure(const Options &opt, const Kernel &kernel, const Shape &s, int threads, int rank, int size, double peak)
+{
+    omp_set_num_threads(threads);
+    setenv("OMP_NUM_THREADS", to_string(threads).c_str(), 1); // kernels that size their own team keep this one
+    vector<double> A, B;
+    if (rank == 0 || !kernel.distributed)
+    {
+        A.assign((long)s.m * s.n, 1);
+        B.assign((long)s.n * s.p, 1);
+    }
+
+    vector<double> times;
+    for (int r = 0; r < opt.warmup + opt.reps; r++)
+    {
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t0 = MPI_Wtime();
+        {
+            TRACE_SCOPE(TRACE_KERNEL, kernel.name.c_str());
+            kernel.run(A, B, s.m, s.n, s.p, rank, size);
+        }
+        double t = MPI_Wtime() - t0;
+        MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        if (r >= opt.warmup)
+            times.push_back(t);
+    }
+
+    sort(times.begin(), times.end());
+    int n = times.size();
+    double median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+    double p95 = times[max(0, (int)ceil(0.95 * n) - 1)];
+    double gflops = 2.0 * s.m * s.n * s.p / median / 1e9;
+    int cores = threads * (kernel.distributed ? size : 1);
+    return {kernel.name, s.name, s.m, s.n, s.p, threads, kernel.distributed ? size : 1, opt.reps,
+            median, p95, times[0], gflops, 100 * gflops / (peak * cores)};
+}
+
+static void write_results(const Options &opt, const vector<Result> &results)
+{
+    ofstream file;
+    if (!opt.output.empty())
+        file.open(opt.output);
+    ostream &out = opt.output.empty() ? cout : file;
+    out.precision(6);
+    if (opt.format == "csv")
+    {
+        out << "kernel,shape,m,n,p,threads,ranks,reps,median_s,p95_s,min_s,gflops,peak_pct\n";
+        for (const Result &r : results)
+            out << r.kernel << ',' << r.shape << ',' << r.m << ',' << r.n << ',' << r.p << ',' << r.threads << ',' << r.ranks << ','
+                << r.reps << ',' << r.median << ',' << r.p95 << ',' << r.min << ',' << r.gflops << ',' << r.peak_pct << '\n';
+        return;
+    }
+    // one record per line, which is also what the baseline reader expects
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        out << "{\"kernel\": \"" << r.kernel << "\", \"shape\": \"" << r.shape << "\", \"m\": " << r.m << ", \"n\": " << r.n
+            << ", \"p\": " << r.p << ", \"threads\": " << r.threads << ", \"ranks\": " << r.ranks << ", \"reps\": " << r.reps
+            << ", \"median_s\": " << r.median << ", \"p95_s\": " << r.p95 << ", \"min_s\": " << r.min
+            << ", \"gflops\": " << r.gflops << ", \"peak_pct\": " << r.peak_pct << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+// Value of "key" in a one-line JSON record written by write_results
+static string json_field(const string &line, const string &key)
+{
+    size_t at = line.find("\"" + key + "\": ");
+    if (at == string::npos)
+        return "";
+    at += key.size() + 4;
+    if (line[at] == '"')
+        return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+    return line.substr(at, line.find_first_of(",}", at) - at);
+}
+
+// Baseline records matched on kernel, shape and configuration; a median more
+// than `tolerance` above the baseline one is a regression. Returns their number.
+static int compare_baseline(const Options &opt, const vector<Result> &results)
+{
+    ifstream in(opt.baseline);
+    if (!in)
+        throw runtime_error("cannot read baseline " + opt.baseline);
+    auto key = [](const string &kernel, int m, int n, int p, int threads, int ranks)
+    {
+        return kernel + ' ' + to_string(m) + 'x' + to_string(n) + 'x' + to_string(p) + ' ' + to_string(threads) + ' ' + to_string(ranks);
+    };
+    vector<pair<string, double>> baseline;
+    for (string line; getline(in, line);)
+        if (line.find("\"kernel\"") != string::npos)
+            baseline.push_back({key(json_field(line, "kernel"), stoi(json_field(line, "m")), stoi(json_field(line, "n")), stoi(json_field(line, "p")),
+                                    stoi(json_field(line, "threads")), stoi(json_field(line, "ranks"))),
+                                stod(json_field(line, "median_s"))});
+
+    int regressions = 0;
+    for (const Result &r : results)
+    {
+        string k = key(r.kernel, r.m, r.n, r.p, r.threads, r.ranks);
+        auto match = find_if(baseline.begin(), baseline.end(), [&](auto &b) { return b.first == k; });
+        if (match == baseline.end())
+            continue;
+        double change = r.median / match->second - 1;
+        bool regressed = change > opt.tolerance;
+        regressions += regressed;
+        fprintf(stderr, "%-8s %-60s %+7.1f%%\n", regressed ? "REGRESS" : "ok", k.c_str(), 100 * change);
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    int rank, size;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Options opt;
+    try
+    {
+        opt = parse_options(argc, argv);
+    }
+    catch (const exception &e)
+    {
+        if (rank == 0)
+            cerr << "bench: " << e.what() << "\n"
+                 << "usage: bench [--size N] [--shape MxNxP]... [--kernels a,b] [--threads 1,2,4] [--warmup W] [--reps R]\n"
+                 << "             [--format json|csv] [--output FILE] [--baseline FILE.json] [--tolerance 0.10] [--trace FILE.json]\n";
+        MPI_Finalize();
+        return 2;
+    }
+
+    // the trace refers to the kernel names, so they outlive the runs
+    static const vector<Kernel> kernels = all_kernels();
+    double peak = core_peak_gflops();
+    vector<Result> results;
+    if (!opt.trace.empty())
+        trace_start_distributed();
+    for (const Kernel &kernel : kernels)
+    {
+        if (!selected(opt, kernel.name) || (!kernel.distributed && size > 1))
+            continue;
+        for (const Shape &s : opt.shapes)
+            for (int threads : kernel.threaded ? opt.threads : vector<int>{1})
+            {
+                results.push_back(measure(opt, kernel, s, threads, rank, size, peak));
+                const Result &r = results.back();
+                if (rank == 0)
+                    fprintf(stderr, "%-26s %-12s %5dx%5dx%5d t=%-3d r=%-3d median %9.4fs p95 %9.4fs %8.2f GFLOP/s %5.1f%% peak\n",
+                            r.kernel.c_str(), r.shape.c_str(), r.m, r.n, r.p, r.threads, r.ranks, r.median, r.p95, r.gflops, r.peak_pct);
+            }
+    }
+
+    if (!opt.trace.empty())
+        trace_write_distributed(opt.trace);
+
+    int status = 0;
+    if (rank == 0)
+    {
+        write_results(opt, results);
+        try
+        {
+            if (!opt.baseline.empty())
+                status = compare_baseline(opt, results) ? 1 : 0;
+        }
+        catch (const exception &e)
+        {
+            cerr << "bench: " << e.what() << "\n";
+            status = 2;
+        }
+    }
+    MPI_Bcast(&status, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Finalize();
+    return status;
+}
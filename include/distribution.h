@@ -0,0 +1,131 @@
+#include "matrix.h"
+#include "mpi_type.h"
+#include <string>
+
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+
+// rows x cols process grid over the ranks of comm, rank r at (r / cols, r % cols)
+struct ProcGrid
+{
+    int rows, cols;
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    bool operator==(const ProcGrid &) const = default;
+};
+
+// Grid for C = A * B (m x p) that minimises the panel traffic of
+// multiply_distributed, n * (m / rows + p / cols) elements per rank
+ProcGrid plan_grid(int m, int p, int size, MPI_Comm comm = MPI_COMM_WORLD);
+
+// Layers of summa_25d_distributed for C = A * B (m x n times n x p) on `size`
+// ranks: the largest c that divides size, is at most its cube root and n, and
+// for which a layer leader's blocks, with c copies of C spread over the ranks,
+// and the K slices of A and B it receives fit in `memory` bytes
+int plan_layers(int m, int n, int p, int size, double memory, int element_size);
+// Bytes every rank of comm can use: the smallest over the ranks of the free
+// memory of its node shared by the node's ranks; MATMUL_RANK_MEMORY overrides
+double rank_memory(MPI_Comm comm = MPI_COMM_WORLD);
+
+// A rows x cols matrix split into near-equal 2D blocks over a process grid:
+// rank r owns the row-major block rows_of(r) x cols_of(r). {size, 1} is a
+// row-block distribution, {1, size} a column-block one.
+struct Distribution
+{
+    int rows, cols;
+    ProcGrid grid;
+
+    pair<int, int> rows_of(int rank) const { return block_range(rows, grid.rows, rank / grid.cols); }
+    pair<int, int> cols_of(int rank) const { return block_range(cols, grid.cols, rank % grid.cols); }
+};
+
+// One rank's block of a distributed matrix; rank is the rank in dist.grid.comm
+template <class T>
+struct DistMatrix
+{
+    Distribution dist;
+    int rank;
+    vector<T> local;
+
+    int local_rows() const { return dist.rows_of(rank).second - dist.rows_of(rank).first; }
+    int local_cols() const { return dist.cols_of(rank).second - dist.cols_of(rank).first; }
+    MatrixView<T> view() { return {local.data(), local_rows(), local_cols(), local_cols()}; }
+    ConstMatrixView<T> view() const { return {local.data(), local_rows(), local_cols(), local_cols()}; }
+};
+
+// Zero-filled block of `rank`
+template <class T>
+DistMatrix<T> make_distributed(const Distribution &dist, int rank)
+{
+    DistMatrix<T> M{dist, rank, {}};
+    M.local.resize((long)M.local_rows() * M.local_cols());
+    return M;
+}
+
+// Optional helpers for data that starts or has to end on one rank. The full
+// matrix M is only read and written on `root`, blocks travel straight out of
+// and into it through strided datatypes.
+template <class T>
+DistMatrix<T> scatter_matrix(ConstMatrixView<T> M, const Distribution &dist, int root, int rank);
+template <class T>
+void gather_matrix(const DistMatrix<T> &local, int root, MatrixView<T> M);
+
+// Row-major vectors: gather returns the full matrix on `root`, an empty one elsewhere
+template <class T>
+DistMatrix<T> scatter_matrix(const vector<T> &M, const Distribution &dist, int root, int rank)
+{
+    return scatter_matrix<T>({M.data(), dist.rows, dist.cols, dist.cols}, dist, root, rank);
+}
+
+template <class T>
+vector<T> gather_matrix(const DistMatrix<T> &local, int root)
+{
+    const Distribution &dist = local.dist;
+    vector<T> M(local.rank == root ? (long)dist.rows * dist.cols : 0);
+    gather_matrix<T>(local, root, {M.data(), dist.rows, dist.cols, dist.cols});
+    return M;
+}
+
+// Collective MPI-IO on a matrix file (matrix_file.h): every rank of
+// grid.comm reads or writes only its own block of the plain Distribution
+// {rows, cols, grid}, through a subarray file view and one
+// MPI_File_read_all / write_all, so the full matrix never exists on any
+// rank. {size, 1} gives even row blocks, plan_grid the SUMMA
+// blocks of multiply_distributed. Reads accept either layout; writes are
+// ROW_MAJOR. Throws runtime_error when the file cannot be opened or does not
+// hold a matrix of T.
+template <class T>
+DistMatrix<T> read_matrix_distributed(const string &path, ProcGrid grid, int rank);
+template <class T>
+void write_matrix_distributed(const string &path, const DistMatrix<T> &M);
+
+// Row offsets of a partition of m rows proportional to the weight every rank
+// of comm passes in: rank r owns [offsets[r], offsets[r + 1])
+vector<int> weighted_rows(int m, double weight, MPI_Comm comm = MPI_COMM_WORLD);
+// Rows [rows[rank], rows[rank + 1]) of root's row-major M (cols columns) by
+// MPI_Scatterv over comm, and the reverse by MPI_Gatherv: the full matrix on
+// root, an empty one elsewhere. rank and root are ranks in comm, the
+// partition the one weighted_rows computed over it.
+template <class T>
+vector<T> scatter_rows(const vector<T> &M, const vector<int> &rows, int cols, int root, int rank, MPI_Comm comm = MPI_COMM_WORLD);
+template <class T>
+vector<T> gather_rows(const vector<T> &local, const vector<int> &rows, int cols, int root, int rank, MPI_Comm comm = MPI_COMM_WORLD);
+// GEMM rate of this rank with the local `product` kernel: the best of a few
+// timed runs of a small double product after a warm-up, so one interruption
+// does not skew the partition; MATMUL_RANK_WEIGHT overrides the measurement
+double kernel_throughput(view_kernel<double> product);
+
+// C = A * B with every operand left distributed: SUMMA over the shared grid of
+// A (m x n) and B (n x p), C comes back on the same grid. `product`
+// accumulates the local C += A * B (multiply_add, multiply_add_omp, ...).
+// Throws invalid_argument when the grids or the inner dimensions differ.
+template <class T>
+DistMatrix<T> multiply_distributed(const DistMatrix<T> &A, const DistMatrix<T> &B, view_kernel<T> product = multiply_add<T>);
+
+// trace_start on every rank of comm right after a barrier, so the ranks share
+// a time origin, and the spans of every rank in one Chrome trace written by
+// rank 0, each rank a process (trace.h)
+void trace_start_distributed(MPI_Comm comm = MPI_COMM_WORLD);
+void trace_write_distributed(const string &path, MPI_Comm comm = MPI_COMM_WORLD);
+
+#endif
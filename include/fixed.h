@@ -0,0 +1,74 @@
+#include "gemm.h"
+#include <utility>
+
+#ifndef FIXED_H
+#define FIXED_H
+
+// f(integral_constant<int, I>{}) for I = 0 .. N - 1, unrolled at compile time
+template <int N, class F>
+inline void static_for(F &&f)
+{
+    [&]<int... I>(integer_sequence<int, I...>) { (f(integral_constant<int, I>{}), ...); }(make_integer_sequence<int, N>{});
+}
+
+// R x Cols tile of C = A * B over all N, R <= MR and Cols <= nr_v<T>: the
+// microkernel's register tile, but read straight from A and B and with every
+// trip count known at compile time. Cols that is not a multiple of the SIMD
+// width becomes a narrower fixed_size_simd, so there is no scalar remainder.
+template <int R, int Cols, int N, class T>
+inline void fixed_tile(const T *A, int lda, const T *B, int ldb, T *C, int ldc)
+{
+    using simd_type = fixed_size_simd<T, Cols>;
+    simd_type c[R];
+    static_for<R>([&](auto i) { c[i] = T(0); });
+    for (int k = 0; k < N; ++k)
+    {
+        simd_type b(B + (long)k * ldb, element_aligned);
+        static_for<R>([&](auto i) { c[i] += simd_type(A[(long)i * lda + k]) * b; });
+    }
+    static_for<R>([&](auto i) { c[i].copy_to(C + (long)i * ldc, element_aligned); });
+}
+
+// R rows of C, nr_v<T> columns at a time and the last P % nr_v<T> in one narrower tile
+template <int R, int N, int P, class T>
+inline void fixed_rows(const T *A, int lda, const T *B, int ldb, T *C, int ldc)
+{
+    constexpr int nr = nr_v<T>;
+    for (int j = 0; j < P / nr * nr; j += nr)
+        fixed_tile<R, nr, N>(A, lda, B + j, ldb, C + j, ldc);
+    if constexpr (P % nr != 0)
+        fixed_tile<R, P % nr, N>(A, lda, B + P / nr * nr, ldb, C + P / nr * nr, ldc);
+}
+
+// C = A * B for M x N times N x P known at compile time, C is not read. Real
+// types run MR x nr_v<T> SIMD register tiles with no packing, zeroing or
+// runtime bounds; complex types keep a row of C in registers. multiply()
+// dispatches to these for the shapes fixed_kernel covers.
+template <int M, int N, int P, class T>
+void multiply_fixed(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
+{
+    if constexpr (is_complex_v<T>)
+    {
+        for (int i = 0; i < M; ++i)
+        {
+            T row[P] = {};
+            for (int k = 0; k < N; ++k)
+            {
+                T a = A.data[(long)i * A.ld + k];
+                for (int j = 0; j < P; ++j)
+                    row[j] += a * B.data[(long)k * B.ld + j];
+            }
+            for (int j = 0; j < P; ++j)
+                C.data[(long)i * C.ld + j] = row[j];
+        }
+    }
+    else
+    {
+        for (int i = 0; i < M / MR * MR; i += MR)
+            fixed_rows<MR, N, P>(A.data + (long)i * A.ld, A.ld, B.data, B.ld, C.data + (long)i * C.ld, C.ld);
+        if constexpr (M % MR != 0)
+            fixed_rows<M % MR, N, P>(A.data + (long)(M / MR * MR) * A.ld, A.ld, B.data, B.ld, C.data + (long)(M / MR * MR) * C.ld, C.ld);
+    }
+}
+
+#endif
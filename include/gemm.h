@@ -0,0 +1,136 @@
+#include "matrix.h"
+#include <functional>
+#include <string>
+
+#ifndef GEMM_H
+#define GEMM_H
+
+// Register tile of the microkernel: MR rows of A times NR columns of B,
+// NR spans two SIMD vectors so the MR x NR tile of C stays in registers.
+constexpr int MR = 6;
+template <class T>
+constexpr int nr_v = 2 * native_simd<T>::size();
+constexpr int NR = nr_v<double>;
+
+// Cache blocking of the packed panels, mc and nc are multiples of MR and
+// nr_v<float>, the widest register tile.
+// Counted in elements and shared by every element type.
+struct Blocking
+{
+    int mc, kc, nc;
+};
+
+// Data/unified cache sizes in bytes.
+struct CacheInfo
+{
+    long l1, l2, l3;
+};
+
+// Reads the cache hierarchy from sysfs, falling back to cpuid via sysconf.
+CacheInfo detect_caches();
+Blocking default_blocking(const CacheInfo &caches);
+// Sweeps candidates around default_blocking() and writes the winner to the tuning file.
+Blocking autotune_blocking();
+// Blocking used by the kernels, resolved once per process: the tuning file
+// ($MATMUL_TUNING_FILE, default ./matmul_tuning.txt) if present, otherwise
+// autotune_blocking() when MATMUL_AUTOTUNE=1, otherwise default_blocking().
+const Blocking &blocking();
+
+using square_kernel = function<void(const vector<double> &, const vector<double> &, int)>;
+// Recursion cutoff stored under `key` in the tuning file. With MATMUL_AUTOTUNE=1
+// and no stored value, picks half the smallest power-of-two size at which one
+// recursion `step` beats the `leaf` kernel; otherwise returns `fallback`.
+int tuned_cutoff(const string &key, int fallback, const square_kernel &leaf, const square_kernel &step);
+
+// Read-only operand in any layout: element (i, j) is data[i * rs + j * cs], so
+// the transpose of a row-major matrix is just rs = 1, cs = ld.
+template <class T>
+struct StridedMat
+{
+    const T *data;
+    long rs, cs;
+
+    StridedMat block(long i, long j) const { return {data + i * rs + j * cs, rs, cs}; }
+};
+
+// op(X) of a row-major matrix with leading dimension ld
+template <class T>
+StridedMat<T> strided(const T *X, int ld, Transpose trans)
+{
+    return trans == NoTrans ? StridedMat<T>{X, ld, 1} : StridedMat<T>{X, 1, ld};
+}
+
+// The packed engine reads operands stored as S and packs, multiplies and
+// accumulates in the real type T (S == T, or float -> double for mixed precision).
+// Packs alpha times an mc x kc block of A into MR-row micro-panels, zero padded to a multiple of MR.
+template <class S, class T>
+void pack_A(StridedMat<S> A, int mc, int kc, T alpha, T *Ap);
+// Packs a kc x nc block of B into nr_v<T>-column micro-panels, zero padded to a multiple of nr_v<T>.
+// Bp must be WORKSPACE_ALIGN aligned: the microkernel loads it with vector_aligned.
+template <class S, class T>
+void pack_B(StridedMat<S> B, int kc, int nc, T *Bp);
+// C(mc x nc) += packed A * packed B
+template <class T>
+void macro_kernel(int mc, int nc, int kc, const T *Ap, const T *Bp, T *C, int ldc);
+// C += alpha * A * B through the packed engine
+template <class S, class T>
+void gemm_packed(T alpha, StridedMat<S> A, StridedMat<S> B, T *C, int ldc, int m, int n, int p, const Blocking &b);
+template <class S, class T>
+void gemm_packed_omp(T alpha, StridedMat<S> A, StridedMat<S> B, T *C, int ldc, int m, int n, int p, const Blocking &b);
+
+// Complex products as four real ones on the interleaved real and imaginary
+// parts (the 4M method): returns P (m x p real part, then m x p imaginary
+// part) = A * B in the calling thread's WS_COMPLEX workspace.
+template <class R>
+using real_gemm_fn = void (*)(R, StridedMat<R>, StridedMat<R>, R *, int, int, int, int, const Blocking &);
+template <class R>
+const R *gemm_4m(StridedMat<complex<R>> A, StridedMat<complex<R>> B, int m, int n, int p, const Blocking &b, real_gemm_fn<R> real_gemm);
+
+// C += alpha * A * B, A: m x n, B: n x p, C row-major; T is any MATMUL_FOR_EACH_TYPE type
+template <class T>
+void gemm(T alpha, StridedMat<T> A, StridedMat<T> B, T *C, int ldc, int m, int n, int p, const Blocking &b = blocking());
+template <class T>
+void gemm_omp(T alpha, StridedMat<T> A, StridedMat<T> B, T *C, int ldc, int m, int n, int p, const Blocking &b = blocking());
+
+// C += A * B on raw row-major storage
+template <class T>
+void gemm(const T *A, int lda, const T *B, int ldb, T *C, int ldc, int m, int n, int p, const Blocking &b = blocking())
+{
+    gemm(T(1), StridedMat<T>{A, lda, 1}, StridedMat<T>{B, ldb, 1}, C, ldc, m, n, p, b);
+}
+
+template <class T>
+void gemm_omp(const T *A, int lda, const T *B, int ldb, T *C, int ldc, int m, int n, int p, const Blocking &b = blocking())
+{
+    gemm_omp(T(1), StridedMat<T>{A, lda, 1}, StridedMat<T>{B, ldb, 1}, C, ldc, m, n, p, b);
+}
+
+// Views of `count` m x n, n x p and m x p matrices stored back to back
+template <class T>
+vector<BatchProduct<T>> uniform_batch(const T *A, const T *B, T *C, int m, int n, int p, int count)
+{
+    vector<BatchProduct<T>> batch(count);
+    for (int i = 0; i < count; i++)
+        batch[i] = {{A + (long)i * m * n, m, n, n}, {B + (long)i * n * p, n, p, p}, {C + (long)i * m * p, m, p, p}};
+    return batch;
+}
+
+// NUMA mode, off unless MATMUL_NUMA=1 or set_numa_mode(true): gemm_omp pins
+// threads node by node, the view multiply_omp first-touches C with the same
+// block ownership the compute loop uses and, with MATMUL_NUMA_REPLICATE=1,
+// each node packs its own copy of the shared B panels. Turning it off gives
+// the pinned threads back their original affinity.
+struct NumaTopology
+{
+    vector<vector<int>> node_cpus; // usable CPUs of every node that has any
+};
+const NumaTopology &numa_topology();
+void set_numa_mode(bool enabled, bool replicate_B = false);
+bool numa_mode();
+bool numa_replicate_B();
+int numa_node_of_thread(int t, int threads);
+// Binds OpenMP thread t to a CPU of node numa_node_of_thread(t); repeated only when the team size
+// changes, and a no-op when called inside a parallel region
+void numa_pin_threads();
+
+#endif
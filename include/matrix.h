@@ -2,8 +2,6 @@
 #include <iostream>
 #include <chrono>
 #include <experimental/simd>
-#define BS 64
-#define THRESHOLD 1024
 
 using namespace std;
 using namespace std::experimental::parallelism_v2;
@@ -20,22 +18,211 @@ enum MPITag
     TAG_B12 = 6,
     TAG_B21 = 7,
     TAG_B22 = 8,
+    TAG_SCATTER = 10,
+    TAG_GATHER = 11,
+    TAG_PANEL_A = 13,
+    TAG_PANEL_C = 14,
+    TAG_LAYER_A = 15,
+    TAG_LAYER_B = 16,
     TAG_RESULT = 100
 };
 #endif
 
-vector<double> add(const vector<double> &A, const vector<double> &B, int size);
-vector<double> sub(const vector<double> &A, const vector<double> &B, int size);
+#ifndef MAT_VIEW_H
+#define MAT_VIEW_H
+#include <complex>
+#include <type_traits>
+
+// Non-owning window into a row-major matrix: element (i, j) is data[i * ld + j]
+template <class T>
+struct MatrixView
+{
+    T *data;
+    int rows, cols, ld;
+
+    MatrixView block(int r0, int c0, int r, int c) const { return {data + (long)r0 * ld + c0, r, c, ld}; }
+};
+
+template <class T>
+struct ConstMatrixView
+{
+    const T *data;
+    int rows, cols, ld;
+
+    ConstMatrixView() : data(nullptr), rows(0), cols(0), ld(0) {}
+    ConstMatrixView(const T *data, int rows, int cols, int ld) : data(data), rows(rows), cols(cols), ld(ld) {}
+    ConstMatrixView(MatrixView<T> v) : data(v.data), rows(v.rows), cols(v.cols), ld(v.ld) {}
+    ConstMatrixView block(int r0, int c0, int r, int c) const { return {data + (long)r0 * ld + c0, r, c, ld}; }
+};
+
+using MatView = MatrixView<double>;
+using ConstMatView = ConstMatrixView<double>;
+
+// Input views are not deduced, the element type comes from the output view,
+// so a MatrixView<T> can be passed where a const view is expected.
+template <class T>
+using const_view_t = typename type_identity<ConstMatrixView<T>>::type;
+
+template <class T>
+struct is_complex : false_type
+{
+};
+template <class T>
+struct is_complex<complex<T>> : true_type
+{
+};
+template <class T>
+constexpr bool is_complex_v = is_complex<T>::value;
+
+template <class T>
+using view_kernel = void (*)(ConstMatrixView<T>, ConstMatrixView<T>, MatrixView<T>);
+
+// One independent C = A * B of a batch
+template <class T>
+struct BatchProduct
+{
+    ConstMatrixView<T> A, B;
+    MatrixView<T> C;
+};
+
+// Every kernel is instantiated for these element types
+#define MATMUL_FOR_EACH_TYPE(X) X(float) X(double) X(complex<float>) X(complex<double>)
+
+enum Transpose
+{
+    NoTrans,
+    Trans
+};
+#endif
+
+template <class T>
+vector<T> add(const vector<T> &A, const vector<T> &B, int size);
+template <class T>
+vector<T> sub(const vector<T> &A, const vector<T> &B, int size);
+// C = A + B, C = A - B; C may alias A or B
+template <class T>
+void add(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C);
+template <class T>
+void sub(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C);
+template <class T>
+void copy_view(const_view_t<T> A, MatrixView<T> C);
+template <class T>
+void zero_view(MatrixView<T> C);
+// C *= beta; beta == 0 clears C even if it holds NaN or Inf
+template <class T>
+void scale_view(MatrixView<T> C, type_identity_t<T> beta);
 int next_pow2(int);
 // A: m * n
 // B: n * p
-vector<double> multiply(const vector<double> &A, const vector<double> &B, int m, int n, int p);
-vector<double> multiply_omp(const vector<double> &A, const vector<double> &B, int m, int n, int p);
-vector<double> strassen(const vector<double> &A, const vector<double> &B, int m, int n, int p);
-vector<double> strassen_omp(const vector<double> &A, const vector<double> &B, int m, int n, int p);
+template <class T>
+vector<T> multiply(const vector<T> &A, const vector<T> &B, int m, int n, int p);
+template <class T>
+vector<T> multiply_omp(const vector<T> &A, const vector<T> &B, int m, int n, int p);
+template <class T>
+vector<T> strassen(const vector<T> &A, const vector<T> &B, int m, int n, int p);
+template <class T>
+vector<T> strassen_omp(const vector<T> &A, const vector<T> &B, int m, int n, int p);
+// C = A * B into caller-provided storage
+template <class T>
+void multiply(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C);
+template <class T>
+void multiply_omp(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C);
+template <class T>
+void strassen(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C);
+template <class T>
+void strassen_omp(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C);
+// The same with the recursion cutoff given instead of tuned
+template <class T>
+void strassen(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C, int cutoff);
+template <class T>
+void strassen_omp(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C, int cutoff);
+// C += A * B
+template <class T>
+void multiply_add(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C);
+template <class T>
+void multiply_add_omp(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C);
+// Independent products C = A * B. The vector overloads take `count` m x n
+// matrices A and n x p matrices B stored back to back and return the count
+// m x p results the same way. multiply_batched_omp runs small products whole,
+// one per thread, and splits each large one over the thread team.
+template <class T>
+void multiply_batched(const vector<BatchProduct<T>> &batch);
+template <class T>
+void multiply_batched_omp(const vector<BatchProduct<T>> &batch);
+template <class T>
+vector<T> multiply_batched(const vector<T> &A, const vector<T> &B, int m, int n, int p, int count);
+template <class T>
+vector<T> multiply_batched_omp(const vector<T> &A, const vector<T> &B, int m, int n, int p, int count);
+// Mixed precision: fp32 storage, products accumulated in fp64 and rounded once
+vector<float> multiply_mixed(const vector<float> &A, const vector<float> &B, int m, int n, int p);
+vector<float> multiply_omp_mixed(const vector<float> &A, const vector<float> &B, int m, int n, int p);
+void multiply_mixed(ConstMatrixView<float> A, ConstMatrixView<float> B, MatrixView<float> C);
+void multiply_omp_mixed(ConstMatrixView<float> A, ConstMatrixView<float> B, MatrixView<float> C);
+// BLAS-style C = alpha * op(A) * op(B) + beta * C on caller-owned row-major
+// storage: op(A) is m x n, op(B) is n x p, lda/ldb/ldc are the row strides of
+// A, B and C as stored. With beta == 0, C is not read.
+void dgemm(Transpose transA, Transpose transB, int m, int n, int p, double alpha, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc);
+void dgemm_omp(Transpose transA, Transpose transB, int m, int n, int p, double alpha, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc);
+// Products with every dimension above the cutoff take a Strassen step (see
+// tuned_cutoff); tuned on double and shared by every element type
+int strassen_cutoff();
+int strassen_omp_cutoff();
+// Elements of scratch a Strassen product needs: the operand sums TA, TB and
+// the product M of each level down to the cutoff
+long strassen_workspace(int m, int n, int p, int cutoff);
 
-vector<double> multiply_mpi(vector<double> &A, vector<double> &B, int m, int n, int p, int rank, int size);
-vector<double> strassen_mpi(const vector<double> &A, const vector<double> &B, int m, int n, int p, int rank, int size);
+template <class T>
+vector<T> multiply_mpi(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+// Whole products of a batch on rank 0 spread over the ranks in proportion to
+// their GEMM rate, each rank runs multiply_batched on its share
+template <class T>
+vector<T> multiply_batched_mpi(const vector<T> &A, const vector<T> &B, int m, int n, int p, int count, int rank, int size);
+template <class T>
+vector<T> strassen_mpi(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
 
-vector<double> multiply_hybrid(vector<double> &A, vector<double> &B, int m, int n, int p, int rank, int size);
-vector<double> strassen_hybrid(const vector<double> &A, const vector<double> &B, int m, int n, int p, int rank, int size);
\ No newline at end of file
+template <class T>
+vector<T> multiply_hybrid(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+template <class T>
+vector<T> strassen_hybrid(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+// multiply_distributed (distribution.h) on rank 0's A and B: they are
+// scattered over plan_grid(m, p, size) and C is gathered back to rank 0.
+// Every SUMMA step broadcasts one K panel of A along the grid rows and of B
+// along the grid columns; `product` accumulates the local C += A * B
+template <class T>
+vector<T> summa_distributed(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size, view_kernel<T> product);
+template <class T>
+vector<T> multiply_summa(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+template <class T>
+vector<T> multiply_summa_hybrid(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+// 2.5D SUMMA: the ranks form plan_layers layers of plan_grid grids, layer l
+// multiplies the l-th slice of the inner dimension with SUMMA into its own
+// copy of C, and the copies are summed into layer 0 and gathered to rank 0.
+// Each rank receives about 1 / sqrt(layers) of the panel traffic of
+// summa_distributed on the same ranks, for `layers` times the memory for C.
+template <class T>
+vector<T> summa_25d_distributed(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size, view_kernel<T> product);
+template <class T>
+vector<T> multiply_summa_25d(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+template <class T>
+vector<T> multiply_summa_25d_hybrid(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+// Row-block distribution pipelined over K panels: B goes out by MPI_Ibcast and
+// the matching columns of every rank's rows of A by Isend, double buffered so
+// panel k + 1 is in flight while `product` accumulates panel k, and the rows
+// of C stream back to rank 0 chunk by chunk as the last panel finishes them
+template <class T>
+vector<T> pipelined_distributed(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size, view_kernel<T> product);
+template <class T>
+vector<T> multiply_mpi_pipelined(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+template <class T>
+vector<T> multiply_hybrid_pipelined(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+// multiply_hybrid with B held once per node: the ranks of a node share it
+// through an MPI shared-memory window, it crosses the network once per node,
+// and unless OMP_NUM_THREADS is set every rank runs cores / ranks-on-node threads
+template <class T>
+vector<T> multiply_hybrid_shared(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size);
+// Strassen over any number of ranks: while there are at least 7, one level
+// splits them into 7 groups, one per M product, that recurse on their own
+// communicators; groups of 2 to 6 ranks fall back to SUMMA with the
+// `accumulate` kernel (C += A * B) and single ranks run `product` (C = A * B)
+template <class T>
+vector<T> strassen_distributed(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size, view_kernel<T> product, view_kernel<T> accumulate);
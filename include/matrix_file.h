@@ -0,0 +1,107 @@
+#include "matrix.h"
+#include <cstdint>
+#include <string>
+
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+// Storage order of the payload; files that predate the field read as ROW_MAJOR
+enum MatrixLayout : int32_t
+{
+    ROW_MAJOR = 0,
+    COL_MAJOR = 1
+};
+
+// On-disk matrix: this header, then the rows x cols elements in `layout`
+// order starting at byte `offset`. New files start the payload on a page
+// (MATRIX_FILE_ALIGN), so it is page aligned once mapped and can be read in
+// page-sized pieces.
+struct MatrixFileHeader
+{
+    char magic[8]; // MATRIX_FILE_MAGIC
+    int64_t rows, cols;
+    int32_t dtype; // file_dtype<T>()
+    int32_t layout;
+    int64_t offset;
+    int64_t unused[3];
+};
+static_assert(sizeof(MatrixFileHeader) == 64);
+constexpr char MATRIX_FILE_MAGIC[8] = {'M', 'A', 'T', 'M', 'U', 'L', '0', '1'};
+constexpr int64_t MATRIX_FILE_ALIGN = 4096;
+
+// Element type code stored in the header
+template <class T>
+constexpr int32_t file_dtype();
+template <>
+constexpr int32_t file_dtype<float>() { return 1; }
+template <>
+constexpr int32_t file_dtype<double>() { return 2; }
+template <>
+constexpr int32_t file_dtype<complex<float>>() { return 3; }
+template <>
+constexpr int32_t file_dtype<complex<double>>() { return 4; }
+
+// Header of a new rows x cols file of T with the payload at MATRIX_FILE_ALIGN
+template <class T>
+MatrixFileHeader make_matrix_header(int rows, int cols, MatrixLayout layout = ROW_MAJOR);
+// Throws runtime_error unless the header read from `path` describes a
+// complete matrix of T in a file of file_size bytes
+template <class T>
+void check_matrix_header(const MatrixFileHeader &header, long file_size, const string &path);
+
+// A matrix file mapped into memory with MAP_SHARED: pages are read on first
+// access and writes go back to the file, nothing is copied. open() checks the
+// header against T and throws runtime_error on a bad or truncated file,
+// create() makes a zero-filled rows x cols file. view() is the payload as
+// stored, so for a COL_MAJOR file it is the cols x rows transpose. Move-only,
+// unmapped and closed on destruction.
+template <class T>
+struct MappedMatrix
+{
+    int rows = 0, cols = 0;
+    MatrixLayout layout = ROW_MAJOR;
+    T *data = nullptr;
+
+    static MappedMatrix open(const string &path, bool writable = false);
+    static MappedMatrix create(const string &path, int rows, int cols, MatrixLayout layout = ROW_MAJOR);
+
+    MappedMatrix() = default;
+    MappedMatrix(MappedMatrix &&other);
+    MappedMatrix &operator=(MappedMatrix &&other);
+    ~MappedMatrix();
+
+    int stored_rows() const { return layout == ROW_MAJOR ? rows : cols; }
+    int stored_cols() const { return layout == ROW_MAJOR ? cols : rows; }
+    MatrixView<T> view() { return {data, stored_rows(), stored_cols(), stored_cols()}; }
+    ConstMatrixView<T> view() const { return {data, stored_rows(), stored_cols(), stored_cols()}; }
+    // Asynchronous readahead (MADV_WILLNEED) of the pages of a block of view()
+    void prefetch(int r0, int c0, int r, int c) const;
+    // Starts writeback of the dirty pages of a block of view() without waiting for it
+    void write_back(int r0, int c0, int r, int c) const;
+
+private:
+    int fd = -1;
+    void *base = nullptr;
+    size_t bytes = 0;
+};
+
+// Writes M to a new matrix file in `layout` order, and reads a whole file back
+// as a row-major matrix. read_matrix_file_omp splits the read into page-aligned
+// pieces that the OpenMP threads pread in parallel, which keeps several
+// requests in flight on NVMe and parallel file systems.
+template <class T>
+void write_matrix_file(const string &path, const_view_t<T> M, MatrixLayout layout = ROW_MAJOR);
+template <class T>
+vector<T> read_matrix_file(const string &path, int &rows, int &cols);
+template <class T>
+vector<T> read_matrix_file_omp(const string &path, int &rows, int &cols);
+
+// C = A * B on ROW_MAJOR matrix files that need not fit in memory: A and B
+// are mapped read-only and C is created with the product's shape. The product
+// is streamed as tiles of A, B and C that together take about memory_bytes;
+// `product` accumulates each tile C += A * B. Throws invalid_argument when the inner
+// dimensions differ or an operand is COL_MAJOR.
+template <class T>
+void multiply_out_of_core(const string &A_path, const string &B_path, const string &C_path, long memory_bytes = 1L << 30, view_kernel<T> product = multiply_add_omp<T>);
+
+#endif
@@ -0,0 +1,37 @@
+#include "matrix.h"
+#include <mpi.h>
+
+#ifndef MPI_TYPE_H
+#define MPI_TYPE_H
+
+// MPI datatype of a matrix element
+template <class T>
+MPI_Datatype mpi_type();
+
+template <>
+inline MPI_Datatype mpi_type<float>() { return MPI_FLOAT; }
+template <>
+inline MPI_Datatype mpi_type<double>() { return MPI_DOUBLE; }
+template <>
+inline MPI_Datatype mpi_type<complex<float>>() { return MPI_CXX_FLOAT_COMPLEX; }
+template <>
+inline MPI_Datatype mpi_type<complex<double>>() { return MPI_CXX_DOUBLE_COMPLEX; }
+
+// [begin, end) of block `idx` when n is split into `parts` near-equal blocks
+inline pair<int, int> block_range(int n, int parts, int idx)
+{
+    return {(int)((long)n * idx / parts), (int)((long)n * (idx + 1) / parts)};
+}
+
+// Rows x cols block of a row-major matrix with leading dimension ld, as one
+// committed MPI element; the caller frees it
+template <class T>
+MPI_Datatype block_type(int rows, int cols, int ld)
+{
+    MPI_Datatype type;
+    MPI_Type_vector(rows, cols, ld, mpi_type<T>(), &type);
+    MPI_Type_commit(&type);
+    return type;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#include "matrix.h"
+
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+// Quadrant index: 0 = X11, 1 = X12, 2 = X21, 3 = X22
+struct Operand
+{
+    int first, second, sign; // second < 0: the operand is the single quadrant `first`
+};
+
+struct StrassenProduct
+{
+    Operand a, b;
+};
+
+static const StrassenProduct strassen_products[7] = {
+    {{0, 3, 1}, {0, 3, 1}},   // M1 = (A11 + A22)(B11 + B22)
+    {{2, 3, 1}, {0, -1, 0}},  // M2 = (A21 + A22) B11
+    {{0, -1, 0}, {1, 3, -1}}, // M3 = A11 (B12 - B22)
+    {{3, -1, 0}, {2, 0, -1}}, // M4 = A22 (B21 - B11)
+    {{0, 1, 1}, {3, -1, 0}},  // M5 = (A11 + A12) B22
+    {{2, 0, -1}, {0, 1, 1}},  // M6 = (A21 - A11)(B11 + B12)
+    {{1, 3, -1}, {2, 3, 1}},  // M7 = (A12 - A22)(B21 + B22)
+};
+
+// Sign of M1..M7 in C11, C12, C21, C22
+static const int strassen_combine[7][4] = {
+    {1, 0, 0, 1}, {0, 0, 1, -1}, {0, 1, 0, 1}, {1, 0, 1, 0}, {-1, 1, 0, 0}, {0, 0, 0, 1}, {1, 0, 0, 0}};
+
+template <class View>
+View quadrant(View X, int q, int rows, int cols)
+{
+    return X.block(q / 2 * rows, q % 2 * cols, rows, cols);
+}
+
+// Sum or difference of two quadrants formed in `buf`, or the quadrant itself
+template <class T>
+ConstMatrixView<T> form_operand(const Operand &op, const ConstMatrixView<T> q[4], MatrixView<T> buf)
+{
+    if (op.second < 0)
+        return q[op.first];
+    if (op.sign > 0)
+        add(q[op.first], q[op.second], buf);
+    else
+        sub(q[op.first], q[op.second], buf);
+    return buf;
+}
+
+#endif
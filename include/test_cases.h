@@ -3,12 +3,37 @@
 #include <cassert>
 
 vector<double> libcheck(const vector<double> &, const vector<double> &, int, int, int);
+// rows x cols entries uniform in [-1, 1), the same for the same seed
+vector<double> random_matrix(int rows, int cols, unsigned seed);
+// Largest absolute difference between two results of the same size
+double max_error(const vector<double> &, const vector<double> &);
 
 void test_strassen_hybrid(int, int, int);
 void test_strassen_mpi(int, int, int);
 void test_strassen_omp(int);
 void test_strassen(int);
 void test_hybrid(int, int, int);
+void test_summa_hybrid(int, int, int);
+void test_summa_25d_hybrid(int, int, int);
+void test_hybrid_pipelined(int, int, int);
+void test_hybrid_shared(int, int, int);
 void test_mpi(int, int, int);
+void test_summa(int, int, int);
+void test_summa_25d(int, int, int);
+void test_mpi_pipelined(int, int, int);
+void test_batched_mpi(int, int, int);
+void test_distributed(int, int, int);
+void test_rows_split(int, int, int);
+void test_file_distributed(int, int, int);
 void test_omp(int);
-void test_serial(int);
\ No newline at end of file
+void test_omp_shapes(int);
+void test_omp_nested(int);
+void test_omp_float_panels(int);
+void test_batched_omp(int);
+void test_out_of_core(int);
+void test_serial(int);
+void test_dgemm(int);
+void test_float(int);
+void test_float_panels(int);
+void test_batched(int);
+void test_fixed(int);
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// What a traced span of the hot path spends its time on
+enum TracePhase
+{
+    TRACE_PACK,    // packing GEMM panels
+    TRACE_COMPUTE, // multiply kernels
+    TRACE_ADD,     // matrix additions and subtractions
+    TRACE_COMM,    // MPI transfers and the waits on them
+    TRACE_COMBINE, // assembling C from partial products
+    TRACE_KERNEL,  // a whole call, marked by the caller
+    TRACE_PHASES
+};
+
+const char *trace_phase_name(TracePhase phase);
+
+// Spans are only recorded in a build with MATMUL_TRACE defined (make TRACE=1)
+// and only between trace_start and the export; otherwise TRACE_SCOPE expands
+// to nothing. `name` must outlive the export, a string literal in practice.
+#ifdef MATMUL_TRACE
+
+// Times the enclosing block on the calling thread, with the perf counters of
+// the thread when MATMUL_TRACE_COUNTERS=1 and `flops` the scope performs
+struct TraceScope
+{
+    TracePhase phase;
+    const char *name;
+    int64_t flops;
+    int64_t start;
+    uint64_t counters[3];
+    bool active;
+
+    TraceScope(TracePhase phase, const char *name, int64_t flops = 0);
+    ~TraceScope();
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#define TRACE_JOIN_(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN_(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_JOIN(trace_scope_, __LINE__)(__VA_ARGS__)
+
+#else
+
+#define TRACE_SCOPE(...) ((void)0)
+
+#endif
+
+// Drops what was recorded so far, restarts the clock and starts recording;
+// `process` is the pid the spans are exported under (the MPI rank). Either
+// call may be made while other threads are inside traced scopes: spans still
+// open at the restart or at the export are dropped.
+void trace_start(int process = 0);
+
+// Stops recording and writes the spans of every thread as Chrome trace JSON
+// (chrome://tracing, Perfetto). In a build without MATMUL_TRACE the file
+// holds no spans.
+void trace_write(const string &path);
+
+// This process's spans as Chrome trace events, comma separated
+string trace_events();
+
+#endif
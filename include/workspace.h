@@ -0,0 +1,49 @@
+#include "matrix.h"
+#include <memory>
+#include <cstdlib>
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+// Every workspace buffer starts on a cache line, which also satisfies the
+// alignment of the widest native SIMD vector.
+constexpr size_t WORKSPACE_ALIGN = 64;
+static_assert(WORKSPACE_ALIGN % memory_alignment_v<native_simd<double>> == 0);
+
+struct AlignedFree
+{
+    void operator()(void *p) const { free(p); }
+};
+using aligned_buffer = unique_ptr<byte[], AlignedFree>;
+
+// Uninitialised WORKSPACE_ALIGN-aligned block of `bytes`. With MATMUL_HUGEPAGES=1
+// blocks of 2 MiB and more are aligned to a huge page and advised for
+// transparent huge pages.
+aligned_buffer aligned_array(size_t bytes);
+
+// Independent scratch buffers of one thread; a kernel only ever holds the
+// slot it owns, so nested calls (Strassen leaf -> gemm) never share one.
+enum WorkspaceSlot
+{
+    WS_PACK_A,
+    WS_PACK_B,
+    WS_PARTIAL,
+    WS_STRASSEN,
+    WS_STRASSEN_TASKS,
+    WS_COMPLEX,
+    WS_MIXED,
+    WS_SLOTS
+};
+
+// At least `bytes` of the calling thread's `slot`, uninitialised and aligned.
+// Buffers only grow and are kept until the thread exits, so repeated calls of
+// the same shape allocate (and page fault) only once.
+void *workspace_bytes(WorkspaceSlot slot, size_t bytes);
+
+template <class T = double>
+T *workspace(WorkspaceSlot slot, long n)
+{
+    return static_cast<T *>(workspace_bytes(slot, n * sizeof(T)));
+}
+
+#endif
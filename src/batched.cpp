@@ -0,0 +1,22 @@
+#include "matrix.h"
+#include "gemm.h"
+
+template <class T>
+void multiply_batched(const vector<BatchProduct<T>> &batch)
+{
+    for (const BatchProduct<T> &b : batch)
+        multiply<T>(b.A, b.B, b.C);
+}
+
+template <class T>
+vector<T> multiply_batched(const vector<T> &A, const vector<T> &B, int m, int n, int p, int count)
+{
+    vector<T> C((long)count * m * p);
+    multiply_batched(uniform_batch(A.data(), B.data(), C.data(), m, n, p, count));
+    return C;
+}
+
+#define INSTANTIATE(T)                                                                                  \
+    template void multiply_batched(const vector<BatchProduct<T>> &);                                  \
+    template vector<T> multiply_batched(const vector<T> &, const vector<T> &, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -0,0 +1,19 @@
+#include "distribution.h"
+
+template <class T>
+vector<T> multiply_batched_mpi(const vector<T> &A, const vector<T> &B, int m, int n, int p, int count, int rank, int /*size*/)
+{
+    // the products are the rows of weighted_rows: every rank gets a run of
+    // whole (A, B) pairs sized by its measured GEMM rate
+    static const double weight = kernel_throughput(multiply<double>);
+    vector<int> products = weighted_rows(count, weight);
+    int local = products[rank + 1] - products[rank];
+    vector<T> local_A = scatter_rows(A, products, m * n, 0, rank);
+    vector<T> local_B = scatter_rows(B, products, n * p, 0, rank);
+
+    vector<T> local_C = multiply_batched(local_A, local_B, m, n, p, local);
+    return gather_rows(local_C, products, m * p, 0, rank);
+}
+
+#define INSTANTIATE(T) template vector<T> multiply_batched_mpi(const vector<T> &, const vector<T> &, int, int, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
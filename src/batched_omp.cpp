@@ -0,0 +1,51 @@
+#include "matrix.h"
+#include "gemm.h"
+#include "omp.h"
+#include <algorithm>
+
+// Products below this many multiply-adds never pay for splitting over a team
+constexpr double BATCH_SPLIT_WORK = 64.0 * 64 * 64;
+
+// A product is split over the whole team when it is large in absolute terms
+// and more than one thread's share of the batch, so running it whole would
+// leave the other threads idle; everything else runs whole on one thread.
+// Whole products go out largest first with dynamic scheduling, which keeps the
+// threads balanced on variable-size batches, and use the serial multiply (and
+// through it the fixed-size kernels), so there is one parallel region for all
+// of them and no per-product fork/join.
+template <class T>
+void multiply_batched_omp(const vector<BatchProduct<T>> &batch)
+{
+    int threads = omp_get_max_threads();
+    auto work = [](const BatchProduct<T> &b) { return (double)b.A.rows * b.A.cols * b.B.cols; };
+    double total = 0;
+    for (const BatchProduct<T> &b : batch)
+        total += work(b);
+
+    vector<int> whole, split;
+    for (int i = 0; i < (int)batch.size(); i++)
+    {
+        double w = work(batch[i]);
+        (w >= BATCH_SPLIT_WORK && w * threads > total ? split : whole).push_back(i);
+    }
+    stable_sort(whole.begin(), whole.end(), [&](int a, int b) { return work(batch[a]) > work(batch[b]); });
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int)whole.size(); i++)
+        multiply<T>(batch[whole[i]].A, batch[whole[i]].B, batch[whole[i]].C);
+    for (int i : split)
+        multiply_omp<T>(batch[i].A, batch[i].B, batch[i].C);
+}
+
+template <class T>
+vector<T> multiply_batched_omp(const vector<T> &A, const vector<T> &B, int m, int n, int p, int count)
+{
+    vector<T> C((long)count * m * p);
+    multiply_batched_omp(uniform_batch(A.data(), B.data(), C.data(), m, n, p, count));
+    return C;
+}
+
+#define INSTANTIATE(T)                                                                                  \
+    template void multiply_batched_omp(const vector<BatchProduct<T>> &);                              \
+    template vector<T> multiply_batched_omp(const vector<T> &, const vector<T> &, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
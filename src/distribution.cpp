@@ -0,0 +1,166 @@
+#include "distribution.h"
+#include "trace.h"
+#include <chrono>
+#include <cstdlib>
+
+// Every rank receives n * (m / rows + p / cols) elements of panels, so pick
+// the factorisation of `size` that minimises m / rows + p / cols.
+ProcGrid plan_grid(int m, int p, int size, MPI_Comm comm)
+{
+    ProcGrid best{size, 1, comm};
+    double best_volume = 1e300;
+    for (int rows = 1; rows <= size; rows++)
+    {
+        if (size % rows)
+            continue;
+        int cols = size / rows;
+        double volume = (double)m / rows + (double)p / cols;
+        if (volume < best_volume)
+        {
+            best_volume = volume;
+            best = {rows, cols, comm};
+        }
+    }
+    return best;
+}
+
+vector<int> weighted_rows(int m, double weight, MPI_Comm comm)
+{
+    int size;
+    MPI_Comm_size(comm, &size);
+    vector<double> weights(size);
+    MPI_Allgather(&weight, 1, MPI_DOUBLE, weights.data(), 1, MPI_DOUBLE, comm);
+
+    double total = 0;
+    for (double w : weights)
+        total += max(w, 0.0);
+    vector<int> offsets(size + 1, 0);
+    double prefix = 0;
+    for (int r = 0; r < size; r++)
+    {
+        prefix += max(weights[r], 0.0);
+        offsets[r + 1] = total > 0 ? (int)llround(m * (prefix / total)) : block_range(m, size, r).second;
+    }
+    offsets[size] = m;
+    return offsets;
+}
+
+// Scatterv/Gatherv counts and displacements of a row partition
+static pair<vector<int>, vector<int>> row_counts(const vector<int> &rows, int cols)
+{
+    int size = rows.size() - 1;
+    vector<int> counts(size), displs(size);
+    for (int r = 0; r < size; r++)
+    {
+        counts[r] = (rows[r + 1] - rows[r]) * cols;
+        displs[r] = rows[r] * cols;
+    }
+    return {counts, displs};
+}
+
+template <class T>
+vector<T> scatter_rows(const vector<T> &M, const vector<int> &rows, int cols, int root, int rank, MPI_Comm comm)
+{
+    TRACE_SCOPE(TRACE_COMM, "scatter_rows");
+    auto [counts, displs] = row_counts(rows, cols);
+    vector<T> local(counts[rank]);
+    MPI_Scatterv(M.data(), counts.data(), displs.data(), mpi_type<T>(), local.data(), counts[rank], mpi_type<T>(), root, comm);
+    return local;
+}
+
+template <class T>
+vector<T> gather_rows(const vector<T> &local, const vector<int> &rows, int cols, int root, int rank, MPI_Comm comm)
+{
+    TRACE_SCOPE(TRACE_COMM, "gather_rows");
+    auto [counts, displs] = row_counts(rows, cols);
+    vector<T> M(rank == root ? (long)rows.back() * cols : 0);
+    MPI_Gatherv(local.data(), counts[rank], mpi_type<T>(), M.data(), counts.data(), displs.data(), mpi_type<T>(), root, comm);
+    return M;
+}
+
+double kernel_throughput(view_kernel<double> product)
+{
+    if (const char *forced = getenv("MATMUL_RANK_WEIGHT"))
+        return atof(forced);
+
+    constexpr int n = 256;
+    vector<double> A(n * n, 1.0), B(n * n, 1.0), C(n * n);
+    ConstMatView A_v{A.data(), n, n, n}, B_v{B.data(), n, n, n};
+    MatView C_v{C.data(), n, n, n};
+    product(A_v, B_v, C_v); // warm-up: workspace, page faults, thread team
+    double best = 1e300;
+    for (int run = 0; run < 3; run++)
+    {
+        auto t0 = chrono::high_resolution_clock::now();
+        product(A_v, B_v, C_v);
+        auto t1 = chrono::high_resolution_clock::now();
+        best = min(best, chrono::duration<double>(t1 - t0).count());
+    }
+    return 2.0 * n * n * n / best;
+}
+
+template <class T>
+DistMatrix<T> scatter_matrix(ConstMatrixView<T> M, const Distribution &dist, int root, int rank)
+{
+    TRACE_SCOPE(TRACE_COMM, "scatter_matrix");
+    DistMatrix<T> local = make_distributed<T>(dist, rank);
+    MPI_Comm comm = dist.grid.comm;
+    if (rank != root)
+    {
+        MPI_Recv(local.local.data(), local.local.size(), mpi_type<T>(), root, TAG_SCATTER, comm, MPI_STATUS_IGNORE);
+        return local;
+    }
+
+    int size = dist.grid.rows * dist.grid.cols;
+    for (int r = 0; r < size; r++)
+    {
+        auto [i0, i1] = dist.rows_of(r);
+        auto [j0, j1] = dist.cols_of(r);
+        ConstMatrixView<T> block = M.block(i0, j0, i1 - i0, j1 - j0);
+        if (r == root)
+        {
+            copy_view(block, local.view());
+            continue;
+        }
+        MPI_Datatype type = block_type<T>(block.rows, block.cols, M.ld);
+        MPI_Send(block.data, 1, type, r, TAG_SCATTER, comm);
+        MPI_Type_free(&type);
+    }
+    return local;
+}
+
+template <class T>
+void gather_matrix(const DistMatrix<T> &local, int root, MatrixView<T> M)
+{
+    TRACE_SCOPE(TRACE_COMM, "gather_matrix");
+    const Distribution &dist = local.dist;
+    MPI_Comm comm = dist.grid.comm;
+    if (local.rank != root)
+    {
+        MPI_Send(local.local.data(), local.local.size(), mpi_type<T>(), root, TAG_GATHER, comm);
+        return;
+    }
+
+    int size = dist.grid.rows * dist.grid.cols;
+    for (int r = 0; r < size; r++)
+    {
+        auto [i0, i1] = dist.rows_of(r);
+        auto [j0, j1] = dist.cols_of(r);
+        MatrixView<T> block = M.block(i0, j0, i1 - i0, j1 - j0);
+        if (r == root)
+        {
+            copy_view(local.view(), block);
+            continue;
+        }
+        MPI_Datatype type = block_type<T>(block.rows, block.cols, M.ld);
+        MPI_Recv(block.data, 1, type, r, TAG_GATHER, comm, MPI_STATUS_IGNORE);
+        MPI_Type_free(&type);
+    }
+}
+
+#define INSTANTIATE(T)                                                                                \
+    template DistMatrix<T> scatter_matrix(ConstMatrixView<T>, const Distribution &, int, int);        \
+    template void gather_matrix(const DistMatrix<T> &, int, MatrixView<T>);                           \
+    template vector<T> scatter_rows(const vector<T> &, const vector<int> &, int, int, int, MPI_Comm); \
+    template vector<T> gather_rows(const vector<T> &, const vector<int> &, int, int, int, MPI_Comm);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
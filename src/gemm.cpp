@@ -0,0 +1,199 @@
+#include "gemm.h"
+#include "workspace.h"
+#include "trace.h"
+
+template <class S, class T>
+void pack_A(StridedMat<S> A, int mc, int kc, T alpha, T *Ap)
+{
+    TRACE_SCOPE(TRACE_PACK, "pack_A");
+    for (int i0 = 0; i0 < mc; i0 += MR)
+    {
+        int mr = min(MR, mc - i0);
+        const S *a = A.data + i0 * A.rs;
+        for (int k = 0; k < kc; ++k)
+        {
+            int i = 0;
+            for (; i < mr; ++i)
+                Ap[i] = alpha * T(a[i * A.rs + k * A.cs]);
+            for (; i < MR; ++i)
+                Ap[i] = T(0);
+            Ap += MR;
+        }
+    }
+}
+
+template <class S, class T>
+void pack_B(StridedMat<S> B, int kc, int nc, T *Bp)
+{
+    TRACE_SCOPE(TRACE_PACK, "pack_B");
+    constexpr int nr_max = nr_v<T>;
+    for (int j0 = 0; j0 < nc; j0 += nr_max)
+    {
+        int nr = min(nr_max, nc - j0);
+        for (int k = 0; k < kc; ++k)
+        {
+            const S *b = B.data + k * B.rs + j0 * B.cs;
+            int j = 0;
+            if (B.cs == 1)
+            {
+                for (; j < nr; ++j)
+                    Bp[j] = T(b[j]);
+            }
+            else
+            {
+                for (; j < nr; ++j)
+                    Bp[j] = T(b[j * B.cs]);
+            }
+            for (; j < nr_max; ++j)
+                Bp[j] = T(0);
+            Bp += nr_max;
+        }
+    }
+}
+
+// Accumulates one MR x NR tile over the whole kc panel in registers,
+// then writes it back to C once.
+template <class T>
+static void micro_kernel(int kc, const T *Ap, const T *Bp, T *C, int ldc, int mr, int nr)
+{
+    using simd_type = native_simd<T>;
+    constexpr int simd_width = simd_type::size();
+    constexpr int nr_max = nr_v<T>;
+
+    simd_type c[MR][2];
+    for (int i = 0; i < MR; ++i)
+    {
+        c[i][0] = T(0);
+        c[i][1] = T(0);
+    }
+
+    for (int k = 0; k < kc; ++k)
+    {
+        simd_type b0(Bp, vector_aligned);
+        simd_type b1(Bp + simd_width, vector_aligned);
+        for (int i = 0; i < MR; ++i)
+        {
+            simd_type a(Ap[i]);
+            c[i][0] += a * b0;
+            c[i][1] += a * b1;
+        }
+        Ap += MR;
+        Bp += nr_max;
+    }
+
+    if (mr == MR && nr == nr_max)
+    {
+        for (int i = 0; i < MR; ++i)
+        {
+            simd_type c0(&C[i * ldc], element_aligned);
+            simd_type c1(&C[i * ldc + simd_width], element_aligned);
+            c0 += c[i][0];
+            c1 += c[i][1];
+            c0.copy_to(&C[i * ldc], element_aligned);
+            c1.copy_to(&C[i * ldc + simd_width], element_aligned);
+        }
+        return;
+    }
+
+    alignas(WORKSPACE_ALIGN) T tile[MR * nr_max];
+    for (int i = 0; i < MR; ++i)
+    {
+        c[i][0].copy_to(&tile[i * nr_max], vector_aligned);
+        c[i][1].copy_to(&tile[i * nr_max + simd_width], vector_aligned);
+    }
+    for (int i = 0; i < mr; ++i)
+        for (int j = 0; j < nr; ++j)
+            C[i * ldc + j] += tile[i * nr_max + j];
+}
+
+template <class T>
+void macro_kernel(int mc, int nc, int kc, const T *Ap, const T *Bp, T *C, int ldc)
+{
+    TRACE_SCOPE(TRACE_COMPUTE, "macro_kernel", 2L * mc * nc * kc);
+    constexpr int nr_max = nr_v<T>;
+    for (int j0 = 0; j0 < nc; j0 += nr_max)
+    {
+        int nr = min(nr_max, nc - j0);
+        for (int i0 = 0; i0 < mc; i0 += MR)
+        {
+            int mr = min(MR, mc - i0);
+            micro_kernel(kc, &Ap[i0 * kc], &Bp[j0 * kc], &C[(long)i0 * ldc + j0], ldc, mr, nr);
+        }
+    }
+}
+
+template <class S, class T>
+void gemm_packed(T alpha, StridedMat<S> A, StridedMat<S> B, T *C, int ldc, int m, int n, int p, const Blocking &b)
+{
+    constexpr int nr_max = nr_v<T>;
+    T *Ap = workspace<T>(WS_PACK_A, (long)b.mc * b.kc);
+    T *Bp = workspace<T>(WS_PACK_B, (long)b.kc * ((min(b.nc, p) + nr_max - 1) / nr_max * nr_max));
+
+    for (int jc = 0; jc < p; jc += b.nc)
+    {
+        int nc = min(b.nc, p - jc);
+        for (int pc = 0; pc < n; pc += b.kc)
+        {
+            int kc = min(b.kc, n - pc);
+            pack_B(B.block(pc, jc), kc, nc, Bp);
+            for (int ic = 0; ic < m; ic += b.mc)
+            {
+                int mc = min(b.mc, m - ic);
+                pack_A(A.block(ic, pc), mc, kc, alpha, Ap);
+                macro_kernel(mc, nc, kc, Ap, Bp, &C[(long)ic * ldc + jc], ldc);
+            }
+        }
+    }
+}
+
+template <class R>
+const R *gemm_4m(StridedMat<complex<R>> A, StridedMat<complex<R>> B, int m, int n, int p, const Blocking &b, real_gemm_fn<R> real_gemm)
+{
+    // complex<R> is laid out as {re, im}, so each part is a view with doubled strides
+    const R *a = reinterpret_cast<const R *>(A.data), *bd = reinterpret_cast<const R *>(B.data);
+    StridedMat<R> Ar{a, 2 * A.rs, 2 * A.cs}, Ai{a + 1, 2 * A.rs, 2 * A.cs};
+    StridedMat<R> Br{bd, 2 * B.rs, 2 * B.cs}, Bi{bd + 1, 2 * B.rs, 2 * B.cs};
+
+    long size = (long)m * p;
+    R *P = workspace<R>(WS_COMPLEX, 2 * size);
+    fill(P, P + 2 * size, R(0));
+    real_gemm(R(1), Ar, Br, P, p, m, n, p, b);
+    real_gemm(R(-1), Ai, Bi, P, p, m, n, p, b);
+    real_gemm(R(1), Ar, Bi, P + size, p, m, n, p, b);
+    real_gemm(R(1), Ai, Br, P + size, p, m, n, p, b);
+    return P;
+}
+
+template <class T>
+void gemm(T alpha, StridedMat<T> A, StridedMat<T> B, T *C, int ldc, int m, int n, int p, const Blocking &b)
+{
+    if constexpr (is_complex_v<T>)
+    {
+        using R = typename T::value_type;
+        const R *P = gemm_4m<R>(A, B, m, n, p, b, gemm_packed<R, R>);
+        long size = (long)m * p;
+        for (int i = 0; i < m; ++i)
+            for (int j = 0; j < p; ++j)
+                C[(long)i * ldc + j] += alpha * T(P[(long)i * p + j], P[size + (long)i * p + j]);
+    }
+    else
+    {
+        gemm_packed<T, T>(alpha, A, B, C, ldc, m, n, p, b);
+    }
+}
+
+#define INSTANTIATE_PACKED(S, T)                                                                                  \
+    template void pack_A(StridedMat<S>, int, int, T, T *);                                                       \
+    template void pack_B(StridedMat<S>, int, int, T *);                                                          \
+    template void gemm_packed(T, StridedMat<S>, StridedMat<S>, T *, int, int, int, int, const Blocking &);
+INSTANTIATE_PACKED(float, float)
+INSTANTIATE_PACKED(double, double)
+INSTANTIATE_PACKED(float, double)
+
+template void macro_kernel(int, int, int, const float *, const float *, float *, int);
+template void macro_kernel(int, int, int, const double *, const double *, double *, int);
+template const float *gemm_4m(StridedMat<complex<float>>, StridedMat<complex<float>>, int, int, int, const Blocking &, real_gemm_fn<float>);
+template const double *gemm_4m(StridedMat<complex<double>>, StridedMat<complex<double>>, int, int, int, const Blocking &, real_gemm_fn<double>);
+
+#define INSTANTIATE(T) template void gemm(T, StridedMat<T>, StridedMat<T>, T *, int, int, int, int, const Blocking &);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
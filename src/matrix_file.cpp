@@ -0,0 +1,181 @@
+#include "matrix_file.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A short read of the header leaves errno alone, it is reported as EIO
+static void check(bool ok, const string &what)
+{
+    if (!ok)
+        throw system_error(errno ? errno : EIO, generic_category(), what);
+}
+
+template <class T>
+MatrixFileHeader make_matrix_header(int rows, int cols, MatrixLayout layout)
+{
+    MatrixFileHeader header{};
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.rows = rows;
+    header.cols = cols;
+    header.dtype = file_dtype<T>();
+    header.layout = layout;
+    header.offset = MATRIX_FILE_ALIGN;
+    return header;
+}
+
+template <class T>
+void check_matrix_header(const MatrixFileHeader &header, long file_size, const string &path)
+{
+    if (memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0)
+        throw runtime_error(path + ": not a matrix file");
+    if (header.dtype != file_dtype<T>())
+        throw runtime_error(path + ": element type does not match");
+    if (header.layout != ROW_MAJOR && header.layout != COL_MAJOR)
+        throw runtime_error(path + ": unknown layout");
+    if (header.rows < 0 || header.cols < 0 || header.offset < (int64_t)sizeof(header) ||
+        file_size < header.offset + header.rows * header.cols * (int64_t)sizeof(T))
+        throw runtime_error(path + ": truncated matrix file");
+}
+
+template <class T>
+MappedMatrix<T> MappedMatrix<T>::open(const string &path, bool writable)
+{
+    MappedMatrix M;
+    M.fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    check(M.fd >= 0, path);
+
+    MatrixFileHeader header;
+    struct stat st;
+    check(pread(M.fd, &header, sizeof(header), 0) == sizeof(header), path);
+    check(fstat(M.fd, &st) == 0, path);
+    check_matrix_header<T>(header, st.st_size, path);
+
+    M.rows = header.rows;
+    M.cols = header.cols;
+    M.layout = MatrixLayout(header.layout);
+    M.bytes = st.st_size;
+    M.base = mmap(nullptr, M.bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, M.fd, 0);
+    check(M.base != MAP_FAILED, path);
+    M.data = reinterpret_cast<T *>(static_cast<char *>(M.base) + header.offset);
+    return M;
+}
+
+template <class T>
+MappedMatrix<T> MappedMatrix<T>::create(const string &path, int rows, int cols, MatrixLayout layout)
+{
+    MatrixFileHeader header = make_matrix_header<T>(rows, cols, layout);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    check(fd >= 0, path);
+    // the payload is left sparse: it reads as zeros until written
+    bool ok = pwrite(fd, &header, sizeof(header), 0) == sizeof(header) &&
+              ftruncate(fd, header.offset + (off_t)rows * cols * sizeof(T)) == 0;
+    int err = errno;
+    close(fd);
+    errno = err;
+    check(ok, path);
+    return open(path, true);
+}
+
+template <class T>
+MappedMatrix<T>::MappedMatrix(MappedMatrix &&other)
+{
+    *this = move(other);
+}
+
+template <class T>
+MappedMatrix<T> &MappedMatrix<T>::operator=(MappedMatrix &&other)
+{
+    swap(rows, other.rows);
+    swap(cols, other.cols);
+    swap(layout, other.layout);
+    swap(data, other.data);
+    swap(fd, other.fd);
+    swap(base, other.base);
+    swap(bytes, other.bytes);
+    return *this;
+}
+
+template <class T>
+MappedMatrix<T>::~MappedMatrix()
+{
+    if (base)
+        munmap(base, bytes);
+    if (fd >= 0)
+        close(fd);
+}
+
+// Calls f(begin, length) for the page-aligned byte ranges of the mapping that
+// cover a block: one range when the block spans whole rows, one per row otherwise
+template <class T, class F>
+static void block_ranges(const MappedMatrix<T> &M, const void *base, int r0, int c0, int r, int c, F f)
+{
+    static const long page = sysconf(_SC_PAGESIZE);
+    auto range = [&](const T *first, long elements)
+    {
+        long begin = (reinterpret_cast<const char *>(first) - static_cast<const char *>(base)) / page * page;
+        long end = reinterpret_cast<const char *>(first + elements) - static_cast<const char *>(base);
+        f(begin, end - begin);
+    };
+    if (r == 0 || c == 0)
+        return;
+    int ld = M.stored_cols();
+    if (c == ld)
+        range(M.data + (long)r0 * ld, (long)r * ld);
+    else
+        for (int i = r0; i < r0 + r; i++)
+            range(M.data + (long)i * ld + c0, c);
+}
+
+template <class T>
+void MappedMatrix<T>::prefetch(int r0, int c0, int r, int c) const
+{
+    block_ranges(*this, base, r0, c0, r, c, [&](long begin, long length)
+                 { madvise(static_cast<char *>(base) + begin, length, MADV_WILLNEED); });
+}
+
+template <class T>
+void MappedMatrix<T>::write_back(int r0, int c0, int r, int c) const
+{
+    block_ranges(*this, base, r0, c0, r, c, [&](long begin, long length)
+                 { sync_file_range(fd, begin, length, SYNC_FILE_RANGE_WRITE); });
+}
+
+template <class T>
+void write_matrix_file(const string &path, const_view_t<T> M, MatrixLayout layout)
+{
+    MappedMatrix<T> file = MappedMatrix<T>::create(path, M.rows, M.cols, layout);
+    if (layout == ROW_MAJOR)
+        copy_view(M, file.view());
+    else
+        for (int i = 0; i < M.rows; i++)
+            for (int j = 0; j < M.cols; j++)
+                file.data[(long)j * M.rows + i] = M.data[(long)i * M.ld + j];
+}
+
+template <class T>
+vector<T> read_matrix_file(const string &path, int &rows, int &cols)
+{
+    MappedMatrix<T> file = MappedMatrix<T>::open(path);
+    rows = file.rows;
+    cols = file.cols;
+    if (file.layout == ROW_MAJOR)
+        return vector<T>(file.data, file.data + (long)rows * cols);
+    vector<T> M((long)rows * cols);
+    for (int j = 0; j < cols; j++)
+        for (int i = 0; i < rows; i++)
+            M[(long)i * cols + j] = file.data[(long)j * rows + i];
+    return M;
+}
+
+#define INSTANTIATE(T)                                                                          \
+    template MatrixFileHeader make_matrix_header<T>(int, int, MatrixLayout);                   \
+    template void check_matrix_header<T>(const MatrixFileHeader &, long, const string &);      \
+    template struct MappedMatrix<T>;                                                           \
+    template void write_matrix_file<T>(const string &, const_view_t<T>, MatrixLayout);        \
+    template vector<T> read_matrix_file<T>(const string &, int &, int &);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
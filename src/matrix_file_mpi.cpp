@@ -0,0 +1,109 @@
+#include "distribution.h"
+#include "matrix_file.h"
+#include <stdexcept>
+
+static void check_mpi(int rc, const string &path)
+{
+    if (rc == MPI_SUCCESS)
+        return;
+    char message[MPI_MAX_ERROR_STRING];
+    int length;
+    MPI_Error_string(rc, message, &length);
+    throw runtime_error(path + ": " + string(message, length));
+}
+
+// File view that exposes exactly this rank's block of the stored rows x cols
+// payload (cols x rows for COL_MAJOR), starting at the header's offset. An
+// empty block gets the element type itself as filetype, with nothing to move.
+template <class T>
+static int set_block_view(MPI_File fh, const MatrixFileHeader &header, int i0, int j0, int r, int c)
+{
+    MPI_Datatype filetype = mpi_type<T>();
+    if (r > 0 && c > 0)
+    {
+        bool col = header.layout == COL_MAJOR;
+        int sizes[2] = {(int)(col ? header.cols : header.rows), (int)(col ? header.rows : header.cols)};
+        int subsizes[2] = {col ? c : r, col ? r : c};
+        int starts[2] = {col ? j0 : i0, col ? i0 : j0};
+        MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, mpi_type<T>(), &filetype);
+        MPI_Type_commit(&filetype);
+    }
+    int rc = MPI_File_set_view(fh, header.offset, mpi_type<T>(), filetype, "native", MPI_INFO_NULL);
+    if (filetype != mpi_type<T>())
+        MPI_Type_free(&filetype);
+    return rc;
+}
+
+template <class T>
+DistMatrix<T> read_matrix_distributed(const string &path, ProcGrid grid, int rank)
+{
+    MPI_File fh;
+    check_mpi(MPI_File_open(grid.comm, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh), path);
+    MatrixFileHeader header;
+    MPI_Offset size;
+    int rc = MPI_File_read_at_all(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    if (rc == MPI_SUCCESS)
+        rc = MPI_File_get_size(fh, &size);
+    try
+    {
+        check_mpi(rc, path);
+        check_matrix_header<T>(header, size, path);
+    }
+    catch (...)
+    {
+        MPI_File_close(&fh);
+        throw;
+    }
+
+    DistMatrix<T> M = make_distributed<T>({(int)header.rows, (int)header.cols, grid}, rank);
+    auto [i0, i1] = M.dist.rows_of(rank);
+    auto [j0, j1] = M.dist.cols_of(rank);
+    int r = i1 - i0, c = j1 - j0;
+
+    // a COL_MAJOR block arrives as its c x r transpose
+    vector<T> stored(header.layout == COL_MAJOR ? M.local.size() : 0);
+    T *dst = header.layout == COL_MAJOR ? stored.data() : M.local.data();
+    rc = set_block_view<T>(fh, header, i0, j0, r, c);
+    if (rc == MPI_SUCCESS)
+        rc = MPI_File_read_all(fh, dst, M.local.size(), mpi_type<T>(), MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    check_mpi(rc, path);
+    if (header.layout == COL_MAJOR)
+        for (int i = 0; i < r; i++)
+            for (int j = 0; j < c; j++)
+                M.local[(long)i * c + j] = stored[(long)j * r + i];
+    return M;
+}
+
+template <class T>
+void write_matrix_distributed(const string &path, const DistMatrix<T> &M)
+{
+    const Distribution &dist = M.dist;
+    MatrixFileHeader header = make_matrix_header<T>(dist.rows, dist.cols);
+    MPI_File fh;
+    check_mpi(MPI_File_open(dist.grid.comm, path.c_str(), MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh), path);
+    int rc = MPI_File_set_size(fh, header.offset + (MPI_Offset)dist.rows * dist.cols * sizeof(T));
+    if (rc == MPI_SUCCESS && M.rank == 0)
+        rc = MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    // only rank 0 knows whether the header went out: every rank has to stop
+    // with it rather than wait in the collective write
+    MPI_Allreduce(MPI_IN_PLACE, &rc, 1, MPI_INT, MPI_MAX, dist.grid.comm);
+    if (rc != MPI_SUCCESS)
+    {
+        MPI_File_close(&fh);
+        check_mpi(rc, path);
+    }
+
+    auto [i0, i1] = dist.rows_of(M.rank);
+    auto [j0, j1] = dist.cols_of(M.rank);
+    rc = set_block_view<T>(fh, header, i0, j0, i1 - i0, j1 - j0);
+    if (rc == MPI_SUCCESS)
+        rc = MPI_File_write_all(fh, M.local.data(), M.local.size(), mpi_type<T>(), MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    check_mpi(rc, path);
+}
+
+#define INSTANTIATE(T)                                                                     \
+    template DistMatrix<T> read_matrix_distributed<T>(const string &, ProcGrid, int);     \
+    template void write_matrix_distributed<T>(const string &, const DistMatrix<T> &);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -0,0 +1,82 @@
+#include "matrix_file.h"
+#include <cerrno>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+
+// Bytes one pread asks for: large enough to stream, small enough that every
+// thread has several pieces to balance over
+constexpr long READ_PIECE = 4L << 20;
+
+// Reads `bytes` at `offset` in READ_PIECE pieces spread over the threads,
+// each piece retried until it is complete; returns 0 or the errno of a failure
+static int pread_parallel(int fd, char *dst, long bytes, long offset)
+{
+    long pieces = (bytes + READ_PIECE - 1) / READ_PIECE;
+    int error = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (long piece = 0; piece < pieces; piece++)
+    {
+        long begin = piece * READ_PIECE, end = min(bytes, begin + READ_PIECE);
+        while (begin < end)
+        {
+            ssize_t got = pread(fd, dst + begin, end - begin, offset + begin);
+            if (got > 0)
+            {
+                begin += got;
+            }
+            else if (got == 0 || errno != EINTR)
+            {
+                #pragma omp atomic write
+                error = got == 0 ? EIO : errno;
+                break;
+            }
+        }
+    }
+    return error;
+}
+
+// Closes the descriptor on every way out of read_matrix_file_omp
+struct FileDescriptor
+{
+    int fd;
+    ~FileDescriptor()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+};
+
+template <class T>
+vector<T> read_matrix_file_omp(const string &path, int &rows, int &cols)
+{
+    FileDescriptor file{open(path.c_str(), O_RDONLY)};
+    MatrixFileHeader header;
+    struct stat st;
+    if (file.fd < 0 || pread(file.fd, &header, sizeof(header), 0) != sizeof(header) || fstat(file.fd, &st) != 0)
+        throw system_error(errno ? errno : EIO, generic_category(), path);
+    check_matrix_header<T>(header, st.st_size, path);
+
+    // a COL_MAJOR payload is read as stored, then transposed in parallel
+    rows = header.rows;
+    cols = header.cols;
+    vector<T> M((long)rows * cols);
+    vector<T> stored(header.layout == COL_MAJOR ? M.size() : 0);
+    T *dst = header.layout == COL_MAJOR ? stored.data() : M.data();
+    if (int error = pread_parallel(file.fd, reinterpret_cast<char *>(dst), M.size() * sizeof(T), header.offset))
+        throw system_error(error, generic_category(), path);
+
+    if (header.layout == COL_MAJOR)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < cols; j++)
+                M[(long)i * cols + j] = stored[(long)j * rows + i];
+    }
+    return M;
+}
+
+#define INSTANTIATE(T) template vector<T> read_matrix_file_omp<T>(const string &, int &, int &);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
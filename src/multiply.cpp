@@ -1,30 +1,96 @@
 #include "matrix.h"
+#include "gemm.h"
+#include "fixed.h"
+#include "workspace.h"
 
-vector<double> multiply(const vector<double> &A, const vector<double> &B, int m, int n, int p)
+void dgemm(Transpose transA, Transpose transB, int m, int n, int p, double alpha, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc)
 {
-    vector<double> C(m * p, 0.0);
-
-    using simd_type = simd<double>;
-    constexpr int simd_size = simd_type::size();
-
-    for (int i0 = 0; i0 < m; i0 += BS)
-        for (int k0 = 0; k0 < n; k0 += BS)
-            for (int j0 = 0; j0 < p; j0 += BS)
-                for (int i = i0; i < min(i0 + BS, m); ++i)
-                    for (int k = k0; k < min(k0 + BS, n); ++k) {
-                        simd_type aik(A[i * n + k]);
-                        int j = j0;
-
-                        for (; j + simd_size - 1 < min(j0 + BS, p); j += simd_size) {
-                            simd_type cVec(&C[i * p + j], element_aligned);
-                            simd_type bVec(&B[k * p + j], element_aligned);
-                            cVec += aik * bVec;
-                            cVec.copy_to(&C[i * p + j], element_aligned);
-                        }
-
-                        for (; j < min(j0 + BS, p); ++j)
-                            C[i * p + j] += A[i * n + k] * B[k * p + j];
-                    }
+    scale_view(MatView{C, m, p, ldc}, beta);
+    if (alpha == 0.0 || n == 0)
+        return;
+    gemm(alpha, strided(A, lda, transA), strided(B, ldb, transB), C, ldc, m, n, p);
+}
 
+// multiply_fixed for the square shapes multiply() specialises, nullptr for any
+// other. The fixed kernels beat the packed engine up to 64 for real types, but
+// for complex ones (a scalar row loop against the 4M SIMD path) only at 4 and 8.
+template <class T>
+static view_kernel<T> fixed_kernel(int m, int n, int p)
+{
+    if (m != n || n != p || (is_complex_v<T> && m > 8))
+        return nullptr;
+    switch (m)
+    {
+    case 4:
+        return multiply_fixed<4, 4, 4, T>;
+    case 8:
+        return multiply_fixed<8, 8, 8, T>;
+    case 12:
+        return multiply_fixed<12, 12, 12, T>;
+    case 16:
+        return multiply_fixed<16, 16, 16, T>;
+    case 24:
+        return multiply_fixed<24, 24, 24, T>;
+    case 32:
+        return multiply_fixed<32, 32, 32, T>;
+    case 48:
+        return multiply_fixed<48, 48, 48, T>;
+    case 64:
+        return multiply_fixed<64, 64, 64, T>;
+    default:
+        return nullptr;
+    }
+}
+
+template <class T>
+vector<T> multiply(const vector<T> &A, const vector<T> &B, int m, int n, int p)
+{
+    vector<T> C(m * p);
+    if (view_kernel<T> fixed = fixed_kernel<T>(m, n, p))
+        fixed({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p});
+    else
+        gemm(A.data(), n, B.data(), p, C.data(), p, m, n, p);
     return C;
 }
+
+template <class T>
+void multiply(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
+{
+    if (view_kernel<T> fixed = fixed_kernel<T>(A.rows, A.cols, B.cols))
+    {
+        fixed(A, B, C);
+        return;
+    }
+    zero_view(C);
+    gemm(A.data, A.ld, B.data, B.ld, C.data, C.ld, A.rows, A.cols, B.cols);
+}
+
+template <class T>
+void multiply_add(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
+{
+    gemm(A.data, A.ld, B.data, B.ld, C.data, C.ld, A.rows, A.cols, B.cols);
+}
+
+void multiply_mixed(ConstMatrixView<float> A, ConstMatrixView<float> B, MatrixView<float> C)
+{
+    int m = A.rows, n = A.cols, p = B.cols;
+    double *Cd = workspace<double>(WS_MIXED, (long)m * p);
+    fill(Cd, Cd + (long)m * p, 0.0);
+    gemm_packed<float, double>(1.0, {A.data, A.ld, 1}, {B.data, B.ld, 1}, Cd, p, m, n, p, blocking());
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < p; ++j)
+            C.data[(long)i * C.ld + j] = float(Cd[(long)i * p + j]);
+}
+
+vector<float> multiply_mixed(const vector<float> &A, const vector<float> &B, int m, int n, int p)
+{
+    vector<float> C(m * p);
+    multiply_mixed({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p});
+    return C;
+}
+
+#define INSTANTIATE(T)                                                                  \
+    template vector<T> multiply(const vector<T> &, const vector<T> &, int, int, int); \
+    template void multiply<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>);      \
+    template void multiply_add<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
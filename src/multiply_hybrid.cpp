@@ -1,24 +1,110 @@
-#include "matrix.h"
-#include <mpi.h>
-
-vector<double> multiply_hybrid(vector<double> &A, vector<double> &B, int m, int n, int p, int rank, int size){
-    int m_padded = ((m + size - 1) / size) * size;
-    B.resize(n * p);
-    int rows_per_proc = m_padded / size;
-    vector<double> C;
-    if(rank == 0){
-        A.resize(m_padded * n);
-        C.resize(m_padded * p);
+#include "distribution.h"
+#include "trace.h"
+#include <omp.h>
+#include <thread>
+#include <cstdlib>
+
+template <class T>
+vector<T> multiply_hybrid(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int /*size*/){
+    // uneven row blocks of A and C, sized by every rank's measured GEMM rate; B replicated
+    static const double weight = kernel_throughput(multiply_omp<double>);
+    vector<int> rows = weighted_rows(m, weight);
+    int local_rows = rows[rank + 1] - rows[rank];
+    vector<T> local_A = scatter_rows(A, rows, n, 0, rank);
+
+    vector<T> B_copy;
+    const T *B_data = B.data();
+    if(rank != 0){
+        B_copy.resize(n * p);
+        B_data = B_copy.data();
+    }
+    {
+        TRACE_SCOPE(TRACE_COMM, "bcast_B");
+        MPI_Bcast(const_cast<T *>(B_data), n * p, mpi_type<T>(), 0, MPI_COMM_WORLD);
     }
-    MPI_Bcast(B.data(), n * p, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    vector<double> local_A(rows_per_proc * n);
-    MPI_Scatter(A.data(), rows_per_proc * n, MPI_DOUBLE, local_A.data(), rows_per_proc * n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
-    vector<double> local_C = multiply_omp(local_A, B, rows_per_proc, n, p);
+    vector<T> local_C(local_rows * p);
+    multiply_omp<T>({local_A.data(), local_rows, n, n}, {B_data, n, p, p}, {local_C.data(), local_rows, p, p});
+    return gather_rows(local_C, rows, p, 0, rank);
+}
 
-    MPI_Gather(local_C.data(), rows_per_proc * p, MPI_DOUBLE, C.data(), rows_per_proc * p, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    if(rank == 0){
-        C.resize(m * p);
+template <class T>
+vector<T> multiply_hybrid_shared(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int /*size*/)
+{
+    // the ranks of this node, and the first rank of every node (world rank 0 leads its node)
+    MPI_Comm node_comm, leaders_comm;
+    int node_rank, node_size;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+    MPI_Comm_split(MPI_COMM_WORLD, node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &leaders_comm);
+
+    // B lives in the node leader's part of the window, the other ranks map it
+    MPI_Win win;
+    T *B_node;
+    MPI_Win_allocate_shared(node_rank == 0 ? (MPI_Aint)n * p * sizeof(T) : 0, sizeof(T), MPI_INFO_NULL, node_comm, &B_node, &win);
+    if (node_rank != 0)
+    {
+        MPI_Aint bytes;
+        int disp_unit;
+        MPI_Win_shared_query(win, 0, &bytes, &disp_unit, &B_node);
+    }
+    {
+        TRACE_SCOPE(TRACE_COMM, "bcast_B");
+        MPI_Win_fence(0, win);
+        if (node_rank == 0)
+        {
+            if (rank == 0)
+                copy(B.begin(), B.end(), B_node);
+            if ((long)n * p > 0)
+                MPI_Bcast(B_node, n * p, mpi_type<T>(), 0, leaders_comm);
+        }
+        MPI_Win_fence(0, win);
     }
+
+    int threads = omp_get_max_threads();
+    if (!getenv("OMP_NUM_THREADS"))
+        omp_set_num_threads(max(1, (int)thread::hardware_concurrency() / node_size));
+
+    // uneven row blocks of A and C as in multiply_hybrid
+    static const double weight = kernel_throughput(multiply_omp<double>);
+    vector<int> rows = weighted_rows(m, weight);
+    int local_rows = rows[rank + 1] - rows[rank];
+    vector<T> local_A = scatter_rows(A, rows, n, 0, rank);
+    vector<T> local_C(local_rows * p);
+    multiply_omp<T>({local_A.data(), local_rows, n, n}, {B_node, n, p, p}, {local_C.data(), local_rows, p, p});
+    vector<T> C = gather_rows(local_C, rows, p, 0, rank);
+
+    omp_set_num_threads(threads);
+    MPI_Win_free(&win);
+    if (leaders_comm != MPI_COMM_NULL)
+        MPI_Comm_free(&leaders_comm);
+    MPI_Comm_free(&node_comm);
     return C;
-}
\ No newline at end of file
+}
+
+template <class T>
+vector<T> multiply_summa_hybrid(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size)
+{
+    return summa_distributed(A, B, m, n, p, rank, size, multiply_add_omp<T>);
+}
+
+template <class T>
+vector<T> multiply_summa_25d_hybrid(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size)
+{
+    return summa_25d_distributed(A, B, m, n, p, rank, size, multiply_add_omp<T>);
+}
+
+template <class T>
+vector<T> multiply_hybrid_pipelined(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size)
+{
+    return pipelined_distributed(A, B, m, n, p, rank, size, multiply_add_omp<T>);
+}
+
+#define INSTANTIATE(T)                                                                                    \
+    template vector<T> multiply_hybrid(const vector<T> &, const vector<T> &, int, int, int, int, int);        \
+    template vector<T> multiply_hybrid_shared(const vector<T> &, const vector<T> &, int, int, int, int, int); \
+    template vector<T> multiply_summa_hybrid(const vector<T> &, const vector<T> &, int, int, int, int, int);  \
+    template vector<T> multiply_summa_25d_hybrid(const vector<T> &, const vector<T> &, int, int, int, int, int); \
+    template vector<T> multiply_hybrid_pipelined(const vector<T> &, const vector<T> &, int, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -1,24 +1,29 @@
-#include "matrix.h"
-#include <mpi.h>
+#include "distribution.h"
+#include "trace.h"
 
-vector<double> multiply_mpi(vector<double> &A, vector<double> &B, int m, int n, int p, int rank, int size){
-    int m_padded = ((m + size - 1) / size) * size;
-    B.resize(n * p);
-    int rows_per_proc = m_padded / size;
-    vector<double> C;
-    if(rank == 0){
-        A.resize(m_padded * n);
-        C.resize(m_padded * p);
+template <class T>
+vector<T> multiply_mpi(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int /*size*/){
+    // uneven row blocks of A and C, sized by every rank's measured GEMM rate; B replicated
+    static const double weight = kernel_throughput(multiply<double>);
+    vector<int> rows = weighted_rows(m, weight);
+    int local_rows = rows[rank + 1] - rows[rank];
+    vector<T> local_A = scatter_rows(A, rows, n, 0, rank);
+
+    vector<T> B_copy;
+    const T *B_data = B.data();
+    if(rank != 0){
+        B_copy.resize(n * p);
+        B_data = B_copy.data();
+    }
+    {
+        TRACE_SCOPE(TRACE_COMM, "bcast_B");
+        MPI_Bcast(const_cast<T *>(B_data), n * p, mpi_type<T>(), 0, MPI_COMM_WORLD);
     }
-    MPI_Bcast(B.data(), n * p, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    vector<double> local_A(rows_per_proc * n);
-    MPI_Scatter(A.data(), rows_per_proc * n, MPI_DOUBLE, local_A.data(), rows_per_proc * n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
-    vector<double> local_C = multiply(local_A, B, rows_per_proc, n, p);
+    vector<T> local_C(local_rows * p);
+    multiply<T>({local_A.data(), local_rows, n, n}, {B_data, n, p, p}, {local_C.data(), local_rows, p, p});
+    return gather_rows(local_C, rows, p, 0, rank);
+}
 
-    MPI_Gather(local_C.data(), rows_per_proc * p, MPI_DOUBLE, C.data(), rows_per_proc * p, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    if(rank == 0){
-        C.resize(m * p);
-    }
-    return C;
-}
\ No newline at end of file
+#define INSTANTIATE(T) template vector<T> multiply_mpi(const vector<T> &, const vector<T> &, int, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -1,30 +1,338 @@
 #include "matrix.h"
+#include "gemm.h"
+#include "workspace.h"
 #include "omp.h"
 
-vector<double> multiply_omp(const vector<double> &A, const vector<double> &B, int m, int n, int p)
-{
-    vector<double> C(m * p, 0.0);
-    using simd_type = simd<double>;
-    constexpr int simd_size = simd_type::size();
-    #pragma omp parallel for
-    for (int i0 = 0; i0 < m; i0 += BS)
-        for (int k0 = 0; k0 < n; k0 += BS)
-            for (int j0 = 0; j0 < p; j0 += BS)
-                for (int i = i0; i < min(i0 + BS, m); ++i)
-                    for (int k = k0; k < min(k0 + BS, n); ++k) {
-                        simd_type aik(A[i * n + k]);
-                        int j = j0;
-                        int j_end = min(j0 + BS, p);
-                        for (; j + simd_size - 1 < j_end; j += simd_size) {
-                            simd_type cVec(&C[i * p + j], element_aligned);
-                            simd_type bVec(&B[k * p + j], element_aligned);
-                            cVec += aik * bVec;
-                            cVec.copy_to(&C[i * p + j], element_aligned);
-                        }
-
-                        for (; j < j_end; ++j)
-                            C[i * p + j] += A[i * n + k] * B[k * p + j];
-                    }
+struct ThreadGrid
+{
+    int tm, tn, tk; // threads along the rows of C, the columns of C and the inner dimension
+};
+
+static int ceil_div(int a, int b)
+{
+    return (a + b - 1) / b;
+}
+
+// [begin, end) of part `idx` of `parts` when n elements are split in units of `unit`
+static pair<int, int> split(int n, int parts, int idx, int unit)
+{
+    int units = ceil_div(n, unit);
+    return {min(n, units * idx / parts * unit), min(n, units * (idx + 1) / parts * unit)};
+}
+
+// Picks the tm x tn x tk split that minimises the busiest thread's estimated
+// cycles: MR x NR tile FMAs, packing A and B, and, when K is split, summing
+// the partial C blocks.
+template <class T>
+static ThreadGrid plan_threads(int m, int n, int p, int threads, const Blocking &b)
+{
+    constexpr int nr = nr_v<T>;
+    const double flops_per_cycle = 2.0 * native_simd<T>::size();
+    ThreadGrid best{threads, 1, 1};
+    double best_cost = 1e300;
+    for (int tk = 1; tk <= threads; tk++)
+    {
+        if (threads % tk || (tk > 1 && ceil_div(n, tk) < b.kc / 4))
+            continue;
+        for (int tm = 1; tm <= threads / tk; tm++)
+        {
+            if ((threads / tk) % tm)
+                continue;
+            int tn = threads / tk / tm;
+            double rows = ceil_div(ceil_div(m, MR), tm) * MR;
+            double cols = ceil_div(ceil_div(p, nr), tn) * nr;
+            double depth = ceil_div(n, tk);
+            double cost = 2 * rows * cols * depth / flops_per_cycle + rows * depth * ceil(cols / b.nc) + depth * cols;
+            if (tk > 1)
+                cost += 2 * rows * cols;
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best = {tm, tn, tk};
+            }
+        }
+    }
+    return best;
+}
+
+// Enough MC row blocks for every thread: B is packed once and shared, row
+// blocks are handed out dynamically. In NUMA mode row blocks are assigned
+// statically to match the first touch of C, and with replication each node
+// packs and reads its own copy of the B panels.
+template <class S, class T>
+static void gemm_omp_rows(T alpha, StridedMat<S> A, StridedMat<S> B, T *C, int ldc, int m, int n, int p, const Blocking &b)
+{
+    constexpr int nr = nr_v<T>;
+    int threads = omp_get_max_threads();
+    int replicas = numa_replicate_B() ? numa_topology().node_cpus.size() : 1;
+    // node copies start on separate pages; the buffer is reused uninitialised,
+    // so its pages are first touched by the threads that pack them
+    long panel = ((long)b.kc * ((min(b.nc, p) + nr - 1) / nr * nr) + 511) / 512 * 512;
+    T *Bp = workspace<T>(WS_PACK_B, panel * replicas);
+    bool static_rows = numa_mode();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        // the team can be smaller than asked for (thread limit, nested region)
+        int t = omp_get_thread_num(), team = omp_get_num_threads();
+        int node = replicas > 1 ? numa_node_of_thread(t, team) : 0;
+        int first = t, last = t;
+        while (first > 0 && numa_node_of_thread(first - 1, team) == node)
+            first--;
+        while (last + 1 < team && numa_node_of_thread(last + 1, team) == node)
+            last++;
+        T *Bp_node = Bp + node * panel;
+
+        T *Ap = workspace<T>(WS_PACK_A, (long)b.mc * b.kc);
+        auto row_block = [&](int ic, int jc, int nc, int pc, int kc)
+        {
+            int mc = min(b.mc, m - ic);
+            pack_A(A.block(ic, pc), mc, kc, alpha, Ap);
+            macro_kernel(mc, nc, kc, Ap, Bp_node, &C[(long)ic * ldc + jc], ldc);
+        };
+
+        for (int jc = 0; jc < p; jc += b.nc)
+        {
+            int nc = min(b.nc, p - jc);
+            for (int pc = 0; pc < n; pc += b.kc)
+            {
+                int kc = min(b.kc, n - pc);
+
+                // every thread packs a share of the nr-wide panels of B
+                if (replicas == 1)
+                {
+                    #pragma omp for
+                    for (int jr = 0; jr < nc; jr += nr)
+                        pack_B(B.block(pc, jc + jr), kc, min(nr, nc - jr), &Bp_node[jr * kc]);
+                }
+                else
+                {
+                    for (int jr = (t - first) * nr; jr < nc; jr += (last - first + 1) * nr)
+                        pack_B(B.block(pc, jc + jr), kc, min(nr, nc - jr), &Bp_node[jr * kc]);
+                    #pragma omp barrier
+                }
+
+                if (static_rows)
+                {
+                    #pragma omp for schedule(static)
+                    for (int ic = 0; ic < m; ic += b.mc)
+                        row_block(ic, jc, nc, pc, kc);
+                }
+                else
+                {
+                    #pragma omp for schedule(dynamic)
+                    for (int ic = 0; ic < m; ic += b.mc)
+                        row_block(ic, jc, nc, pc, kc);
+                }
+            }
+        }
+    }
+}
+
+// Grid of the team that actually started: when it is smaller than the
+// planned one, every thread of it replans the same grid for its size
+template <class T>
+static ThreadGrid team_grid(ThreadGrid g, int m, int n, int p, const Blocking &b)
+{
+    int team = omp_get_num_threads();
+    return team == g.tm * g.tn * g.tk ? g : plan_threads<T>(m, n, p, team, b);
+}
+
+// Every thread owns one block of a tm x tn x tk grid over C and K. With K
+// split, partial blocks are summed after a barrier, each of the tk owners of
+// a C block adding one slice of its rows. The grid is that of the team, one
+// block per started thread, so every partial slot read was written.
+template <class S, class T>
+static void gemm_omp_grid(T alpha, StridedMat<S> A, StridedMat<S> B, T *C, int ldc, int m, int n, int p, const Blocking &b, ThreadGrid planned)
+{
+    vector<T *> partial(planned.tm * planned.tn * planned.tk);
+
+    #pragma omp parallel num_threads(planned.tm * planned.tn * planned.tk)
+    {
+        ThreadGrid g = team_grid<T>(planned, m, n, p, b);
+        int t = omp_get_thread_num();
+        int it = t % g.tm, jt = t / g.tm % g.tn, kt = t / (g.tm * g.tn);
+        auto [i0, i1] = split(m, g.tm, it, MR);
+        auto [j0, j1] = split(p, g.tn, jt, nr_v<T>);
+        auto [k0, k1] = split(n, g.tk, kt, 1);
+        int rows = i1 - i0, cols = j1 - j0;
+
+        if (g.tk == 1)
+        {
+            gemm_packed(alpha, A.block(i0, 0), B.block(0, j0), &C[(long)i0 * ldc + j0], ldc, rows, n, cols, b);
+        }
+        else
+        {
+            partial[t] = workspace<T>(WS_PARTIAL, (long)rows * cols);
+            fill(partial[t], partial[t] + (long)rows * cols, T(0));
+            gemm_packed(alpha, A.block(i0, k0), B.block(k0, j0), partial[t], cols, rows, k1 - k0, cols, b);
+
+            #pragma omp barrier
+            auto [r0, r1] = split(rows, g.tk, kt, 1);
+            for (int k = 0; k < g.tk; k++)
+            {
+                const T *P = partial[it + jt * g.tm + k * g.tm * g.tn];
+                for (int i = r0; i < r1; i++)
+                    for (int j = 0; j < cols; j++)
+                        C[(long)(i0 + i) * ldc + j0 + j] += P[(long)i * cols + j];
+            }
+        }
+    }
+}
+
+static bool use_row_blocks(ThreadGrid g, int m, const Blocking &b, int threads)
+{
+    return g.tn == 1 && g.tk == 1 && ceil_div(m, b.mc) >= threads;
+}
+
+template <class S, class T>
+void gemm_packed_omp(T alpha, StridedMat<S> A, StridedMat<S> B, T *C, int ldc, int m, int n, int p, const Blocking &b)
+{
+    if (m == 0 || p == 0)
+        return;
+    if (numa_mode())
+        numa_pin_threads();
+    int threads = omp_get_max_threads();
+    ThreadGrid g = plan_threads<T>(m, n, p, threads, b);
+    if (use_row_blocks(g, m, b, threads))
+        gemm_omp_rows(alpha, A, B, C, ldc, m, n, p, b);
+    else
+        gemm_omp_grid(alpha, A, B, C, ldc, m, n, p, b, g);
+}
+
+template <class T>
+void gemm_omp(T alpha, StridedMat<T> A, StridedMat<T> B, T *C, int ldc, int m, int n, int p, const Blocking &b)
+{
+    if constexpr (is_complex_v<T>)
+    {
+        using R = typename T::value_type;
+        const R *P = gemm_4m<R>(A, B, m, n, p, b, gemm_packed_omp<R, R>);
+        long size = (long)m * p;
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < m; ++i)
+            for (int j = 0; j < p; ++j)
+                C[(long)i * ldc + j] += alpha * T(P[(long)i * p + j], P[size + (long)i * p + j]);
+    }
+    else
+    {
+        gemm_packed_omp<T, T>(alpha, A, B, C, ldc, m, n, p, b);
+    }
+}
+
+// Zeroes C (m x p, inner dimension n) with the thread -> rows/block ownership
+// gemm_omp will use for it, so every page is first touched where it is computed.
+template <class T>
+static void zero_owned(MatrixView<T> C, int n, const Blocking &b)
+{
+    numa_pin_threads();
+    int m = C.rows, p = C.cols;
+    int threads = omp_get_max_threads();
+    ThreadGrid g = plan_threads<T>(m, n, p, threads, b);
+    if (use_row_blocks(g, m, b, threads))
+    {
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for (int ic = 0; ic < m; ic += b.mc)
+            zero_view(C.block(ic, 0, min(b.mc, m - ic), p));
+        return;
+    }
+
+    #pragma omp parallel num_threads(g.tm * g.tn * g.tk)
+    {
+        ThreadGrid tg = team_grid<T>(g, m, n, p, b);
+        int t = omp_get_thread_num();
+        int it = t % tg.tm, jt = t / tg.tm % tg.tn, kt = t / (tg.tm * tg.tn);
+        auto [i0, i1] = split(m, tg.tm, it, MR);
+        auto [j0, j1] = split(p, tg.tn, jt, nr_v<T>);
+        auto [r0, r1] = split(i1 - i0, tg.tk, kt, 1);
+        zero_view(C.block(i0 + r0, j0, r1 - r0, j1 - j0));
+    }
+}
+
+// Clears C before a product of inner dimension n. Complex results are written
+// by static row blocks of the 4M combine, so they are cleared the same way.
+template <class T>
+static void zero_for_gemm(MatrixView<T> C, int n)
+{
+    if constexpr (!is_complex_v<T>)
+    {
+        if (numa_mode())
+        {
+            zero_owned(C, n, blocking());
+            return;
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r < C.rows; ++r)
+        zero_view(C.block(r, 0, 1, C.cols));
+}
 
+void dgemm_omp(Transpose transA, Transpose transB, int m, int n, int p, double alpha, const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc)
+{
+    MatView C_v{C, m, p, ldc};
+    if (beta == 0.0)
+    {
+        zero_for_gemm(C_v, n);
+    }
+    else if (beta != 1.0)
+    {
+        #pragma omp parallel for
+        for (int r = 0; r < m; ++r)
+            scale_view(C_v.block(r, 0, 1, p), beta);
+    }
+    if (alpha == 0.0 || n == 0)
+        return;
+    gemm_omp(alpha, strided(A, lda, transA), strided(B, ldb, transB), C, ldc, m, n, p);
+}
+
+// The result vector is zero-filled on the calling thread, so its pages land on
+// that thread's node regardless of NUMA mode.
+template <class T>
+vector<T> multiply_omp(const vector<T> &A, const vector<T> &B, int m, int n, int p)
+{
+    vector<T> C(m * p);
+    gemm_omp(A.data(), n, B.data(), p, C.data(), p, m, n, p);
     return C;
 }
+
+template <class T>
+void multiply_omp(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
+{
+    zero_for_gemm(C, A.cols);
+    gemm_omp(A.data, A.ld, B.data, B.ld, C.data, C.ld, A.rows, A.cols, B.cols);
+}
+
+template <class T>
+void multiply_add_omp(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
+{
+    gemm_omp(A.data, A.ld, B.data, B.ld, C.data, C.ld, A.rows, A.cols, B.cols);
+}
+
+void multiply_omp_mixed(ConstMatrixView<float> A, ConstMatrixView<float> B, MatrixView<float> C)
+{
+    int m = A.rows, n = A.cols, p = B.cols;
+    MatrixView<double> Cd{workspace<double>(WS_MIXED, (long)m * p), m, p, p};
+    zero_for_gemm(Cd, n);
+    gemm_packed_omp<float, double>(1.0, {A.data, A.ld, 1}, {B.data, B.ld, 1}, Cd.data, p, m, n, p, blocking());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < m; ++i)
+        for (int j = 0; j < p; ++j)
+            C.data[(long)i * C.ld + j] = float(Cd.data[(long)i * p + j]);
+}
+
+vector<float> multiply_omp_mixed(const vector<float> &A, const vector<float> &B, int m, int n, int p)
+{
+    vector<float> C(m * p);
+    multiply_omp_mixed({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p});
+    return C;
+}
+
+template void gemm_packed_omp(float, StridedMat<float>, StridedMat<float>, float *, int, int, int, int, const Blocking &);
+template void gemm_packed_omp(double, StridedMat<double>, StridedMat<double>, double *, int, int, int, int, const Blocking &);
+template void gemm_packed_omp(double, StridedMat<float>, StridedMat<float>, double *, int, int, int, int, const Blocking &);
+
+#define INSTANTIATE(T)                                                                                          \
+    template void gemm_omp(T, StridedMat<T>, StridedMat<T>, T *, int, int, int, int, const Blocking &);       \
+    template vector<T> multiply_omp(const vector<T> &, const vector<T> &, int, int, int);                     \
+    template void multiply_omp<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>);                          \
+    template void multiply_add_omp<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
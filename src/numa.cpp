@@ -0,0 +1,132 @@
+#include "gemm.h"
+#include <omp.h>
+#include <sched.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+
+static bool numa_enabled = getenv("MATMUL_NUMA") && atoi(getenv("MATMUL_NUMA"));
+static bool numa_replicate = getenv("MATMUL_NUMA_REPLICATE") && atoi(getenv("MATMUL_NUMA_REPLICATE"));
+
+// "0-3,8-11" -> {0, 1, 2, 3, 8, 9, 10, 11}
+static vector<int> parse_cpulist(const string &list)
+{
+    vector<int> cpus;
+    stringstream ss(list);
+    string range;
+    while (getline(ss, range, ','))
+    {
+        if (range.empty())
+            continue;
+        size_t dash = range.find('-');
+        int lo = stoi(range.substr(0, dash));
+        int hi = dash == string::npos ? lo : stoi(range.substr(dash + 1));
+        for (int c = lo; c <= hi; c++)
+            cpus.push_back(c);
+    }
+    return cpus;
+}
+
+static NumaTopology detect_topology()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    NumaTopology topo;
+    for (int node = 0;; node++)
+    {
+        ifstream in("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        if (!in)
+            break;
+        string list;
+        getline(in, list);
+        vector<int> cpus;
+        for (int c : parse_cpulist(list))
+            if (CPU_ISSET(c, &allowed))
+                cpus.push_back(c);
+        if (!cpus.empty())
+            topo.node_cpus.push_back(cpus);
+    }
+    if (topo.node_cpus.empty())
+    {
+        topo.node_cpus.emplace_back();
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &allowed))
+                topo.node_cpus[0].push_back(c);
+    }
+    return topo;
+}
+
+const NumaTopology &numa_topology()
+{
+    static const NumaTopology topo = detect_topology();
+    return topo;
+}
+
+// Team size numa_pin_threads last pinned, and the affinity the threads had before
+static int pinned_threads = 0;
+static cpu_set_t unpinned;
+
+// Gives the pinned threads back the affinity they had before numa_pin_threads
+static void numa_unpin_threads()
+{
+    if (pinned_threads == 0)
+        return;
+    #pragma omp parallel num_threads(pinned_threads)
+    sched_setaffinity(0, sizeof(unpinned), &unpinned);
+    pinned_threads = 0;
+}
+
+void set_numa_mode(bool enabled, bool replicate_B)
+{
+    numa_enabled = enabled;
+    numa_replicate = replicate_B;
+    if (!enabled)
+        numa_unpin_threads();
+}
+
+bool numa_mode()
+{
+    return numa_enabled;
+}
+
+bool numa_replicate_B()
+{
+    return numa_enabled && numa_replicate;
+}
+
+// Consecutive threads share a node so neighbouring blocks of the partition stay on one socket
+int numa_node_of_thread(int t, int threads)
+{
+    return (long)t * numa_topology().node_cpus.size() / threads;
+}
+
+// Only the top level pins: a nested team has one thread, which would take
+// node 0's first CPU, and pinned_threads is not guarded against other teams
+void numa_pin_threads()
+{
+    int threads = omp_get_max_threads();
+    if (omp_in_parallel() || pinned_threads == threads)
+        return;
+    if (pinned_threads == 0)
+        sched_getaffinity(0, sizeof(unpinned), &unpinned);
+
+    const NumaTopology &topo = numa_topology();
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num(), team = omp_get_num_threads();
+        int node = numa_node_of_thread(t, team);
+        int first = 0;
+        while (numa_node_of_thread(first, team) != node)
+            first++;
+        const vector<int> &cpus = topo.node_cpus[node];
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[(t - first) % cpus.size()], &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    pinned_threads = threads;
+}
@@ -0,0 +1,74 @@
+#include "matrix_file.h"
+#include <cmath>
+#include <stdexcept>
+
+struct OocStep
+{
+    int i, j, k; // tile indices along the rows of C, the columns of C and K
+};
+
+// Tile order that reuses what the page cache already holds: the columns of C
+// snake back and forth along each tile row and the K tiles reverse at every C
+// tile, so each C tile starts on the A tile (and at a row change, the B tile)
+// its predecessor finished with.
+static vector<OocStep> ooc_order(int tiles_m, int tiles_n, int tiles_p)
+{
+    vector<OocStep> order;
+    bool k_down = false;
+    for (int i = 0; i < tiles_m; i++)
+        for (int jj = 0; jj < tiles_p; jj++, k_down = !k_down)
+        {
+            int j = i % 2 ? tiles_p - 1 - jj : jj;
+            for (int kk = 0; kk < tiles_n; kk++)
+                order.push_back({i, j, k_down ? tiles_n - 1 - kk : kk});
+        }
+    return order;
+}
+
+template <class T>
+void multiply_out_of_core(const string &A_path, const string &B_path, const string &C_path, long memory_bytes, view_kernel<T> product)
+{
+    MappedMatrix<T> A = MappedMatrix<T>::open(A_path);
+    MappedMatrix<T> B = MappedMatrix<T>::open(B_path);
+    if (A.cols != B.rows)
+        throw invalid_argument("multiply_out_of_core: inner dimensions differ");
+    if (A.layout != ROW_MAJOR || B.layout != ROW_MAJOR)
+        throw invalid_argument("multiply_out_of_core: operands must be ROW_MAJOR");
+    int m = A.rows, n = A.cols, p = B.cols;
+    MappedMatrix<T> C = MappedMatrix<T>::create(C_path, m, p);
+    if (m == 0 || n == 0 || p == 0)
+        return;
+
+    // three square tiles in the budget, in whole 64-element steps
+    long budget = max(1L, memory_bytes / (long)sizeof(T) / 3);
+    int tile = max(64, (int)sqrt((double)budget) / 64 * 64);
+    int tm = min(m, tile), tn = min(n, tile), tp = min(p, tile);
+    int tiles_m = (m + tm - 1) / tm, tiles_n = (n + tn - 1) / tn, tiles_p = (p + tp - 1) / tp;
+
+    auto fetch = [&](const OocStep &s)
+    {
+        int i0 = s.i * tm, j0 = s.j * tp, k0 = s.k * tn;
+        A.prefetch(i0, k0, min(tm, m - i0), min(tn, n - k0));
+        B.prefetch(k0, j0, min(tn, n - k0), min(tp, p - j0));
+    };
+
+    // while one step multiplies out of the mapping, the kernel reads the next
+    // step's tiles ahead; a C tile leaves for the disk as soon as its last K
+    // tile is done, so writeback overlaps the rest of the product
+    vector<OocStep> order = ooc_order(tiles_m, tiles_n, tiles_p);
+    fetch(order[0]);
+    for (size_t s = 0; s < order.size(); s++)
+    {
+        if (s + 1 < order.size())
+            fetch(order[s + 1]);
+        auto [i, j, k] = order[s];
+        int i0 = i * tm, j0 = j * tp, k0 = k * tn;
+        int rows = min(tm, m - i0), cols = min(tp, p - j0), depth = min(tn, n - k0);
+        product(A.view().block(i0, k0, rows, depth), B.view().block(k0, j0, depth, cols), C.view().block(i0, j0, rows, cols));
+        if (s + 1 == order.size() || order[s + 1].i != i || order[s + 1].j != j)
+            C.write_back(i0, j0, rows, cols);
+    }
+}
+
+#define INSTANTIATE(T) template void multiply_out_of_core<T>(const string &, const string &, const string &, long, view_kernel<T>);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -0,0 +1,122 @@
+#include "matrix.h"
+#include "gemm.h"
+#include "mpi_type.h"
+#include "trace.h"
+
+// Each K panel is multiplied in about this many row chunks, so MPI can make
+// progress on the next panel in between and the rows of C finished by the last
+// panel can leave before the rest of it is done
+constexpr int PIPELINE_CHUNKS = 4;
+
+static int chunk_rows(int rows)
+{
+    return max(blocking().mc, (rows + PIPELINE_CHUNKS - 1) / PIPELINE_CHUNKS);
+}
+
+template <class T>
+vector<T> pipelined_distributed(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size, view_kernel<T> product)
+{
+    if (m == 0 || n == 0 || p == 0)
+        return vector<T>(rank == 0 ? (long)m * p : 0);
+
+    int panel = blocking().kc;
+    auto [r0, r1] = block_range(m, size, rank);
+    int rows = r1 - r0, chunk = chunk_rows(rows);
+
+    // rank 0 computes straight into C and posts everything it sends and
+    // receives up front: every A panel of every other rank, out of A through
+    // a strided datatype, and every chunk of C rows it will get back
+    vector<T> C, C_local;
+    vector<MPI_Request> pending;
+    if (rank == 0)
+    {
+        C.resize((long)m * p);
+        for (int r = 1; r < size; r++)
+        {
+            auto [s0, s1] = block_range(m, size, r);
+            if (s0 == s1)
+                continue;
+            for (int k = 0; k < n; k += panel)
+            {
+                MPI_Datatype type = block_type<T>(s1 - s0, min(panel, n - k), n);
+                pending.emplace_back();
+                MPI_Isend(&A[(long)s0 * n + k], 1, type, r, TAG_PANEL_A, MPI_COMM_WORLD, &pending.back());
+                MPI_Type_free(&type);
+            }
+            for (int i = s0, h = chunk_rows(s1 - s0); i < s1; i += h)
+            {
+                pending.emplace_back();
+                MPI_Irecv(&C[(long)i * p], min(h, s1 - i) * p, mpi_type<T>(), r, TAG_PANEL_C, MPI_COMM_WORLD, &pending.back());
+            }
+        }
+    }
+    else
+    {
+        C_local.resize((long)rows * p);
+    }
+    MatrixView<T> C_v{rank == 0 ? C.data() : C_local.data(), rows, p, p};
+
+    // two slots of A and B panels: one being multiplied, one arriving
+    vector<T> A_buf[2], B_buf[2];
+    MPI_Request arriving[2][2];
+    auto post = [&](int k, int slot)
+    {
+        int kw = min(panel, n - k);
+        arriving[slot][0] = MPI_REQUEST_NULL;
+        if (rank != 0)
+        {
+            A_buf[slot].resize((long)rows * panel);
+            B_buf[slot].resize((long)panel * p);
+            if (rows > 0)
+                MPI_Irecv(A_buf[slot].data(), rows * kw, mpi_type<T>(), 0, TAG_PANEL_A, MPI_COMM_WORLD, &arriving[slot][0]);
+        }
+        T *B_panel = rank == 0 ? const_cast<T *>(&B[(long)k * p]) : B_buf[slot].data();
+        MPI_Ibcast(B_panel, kw * p, mpi_type<T>(), 0, MPI_COMM_WORLD, &arriving[slot][1]);
+    };
+
+    post(0, 0);
+    for (int k = 0, slot = 0; k < n; k += panel, slot ^= 1)
+    {
+        int kw = min(panel, n - k);
+        bool last = k + kw == n;
+        {
+            TRACE_SCOPE(TRACE_COMM, "wait_panels");
+            MPI_Waitall(2, arriving[slot], MPI_STATUSES_IGNORE);
+        }
+        if (!last)
+            post(k + kw, slot ^ 1);
+
+        ConstMatrixView<T> A_panel = rank == 0 ? ConstMatrixView<T>{&A[k], rows, kw, n} : ConstMatrixView<T>{A_buf[slot].data(), rows, kw, kw};
+        ConstMatrixView<T> B_panel{rank == 0 ? &B[(long)k * p] : B_buf[slot].data(), kw, p, p};
+        for (int i = 0; i < rows; i += chunk)
+        {
+            int h = min(chunk, rows - i);
+            product(A_panel.block(i, 0, h, kw), B_panel, C_v.block(i, 0, h, p));
+            if (!last)
+            {
+                int done;
+                MPI_Testall(2, arriving[slot ^ 1], &done, MPI_STATUSES_IGNORE);
+            }
+            else if (rank != 0)
+            {
+                pending.emplace_back();
+                MPI_Isend(&C_local[(long)i * p], h * p, mpi_type<T>(), 0, TAG_PANEL_C, MPI_COMM_WORLD, &pending.back());
+            }
+        }
+    }
+
+    TRACE_SCOPE(TRACE_COMM, "wait_results");
+    MPI_Waitall(pending.size(), pending.data(), MPI_STATUSES_IGNORE);
+    return C;
+}
+
+template <class T>
+vector<T> multiply_mpi_pipelined(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size)
+{
+    return pipelined_distributed(A, B, m, n, p, rank, size, multiply_add<T>);
+}
+
+#define INSTANTIATE(T)                                                                                                       \
+    template vector<T> pipelined_distributed(const vector<T> &, const vector<T> &, int, int, int, int, int, view_kernel<T>); \
+    template vector<T> multiply_mpi_pipelined(const vector<T> &, const vector<T> &, int, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -1,57 +1,129 @@
 #include "matrix.h"
+#include "gemm.h"
+#include "workspace.h"
 
-vector<double> strassen(const vector<double> &A, const vector<double> &B, int m, int n, int p)
+// C = A * B, C must not alias A or B
+template <class T>
+static void strassen_rec(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C, T *ws, int cutoff)
 {
-    if (m <= THRESHOLD || m != n || n != p)
+    int m = A.rows, n = A.cols, p = B.cols;
+    if (min(m, min(n, p)) <= cutoff)
     {
-        return multiply(A, B, m, n, p);
+        multiply<T>(A, B, C);
+        return;
     }
 
-    int h = m / 2;
-    int hs = h * h;
+    // Strassen on the even part, the odd row/column/inner index is peeled off below
+    int hm = m / 2, hn = n / 2, hp = p / 2;
 
-    vector<double> A11(hs), A12(hs), A21(hs), A22(hs);
-    vector<double> B11(hs), B12(hs), B21(hs), B22(hs);
+    auto A11 = A.block(0, 0, hm, hn), A12 = A.block(0, hn, hm, hn);
+    auto A21 = A.block(hm, 0, hm, hn), A22 = A.block(hm, hn, hm, hn);
+    auto B11 = B.block(0, 0, hn, hp), B12 = B.block(0, hp, hn, hp);
+    auto B21 = B.block(hn, 0, hn, hp), B22 = B.block(hn, hp, hn, hp);
+    auto C11 = C.block(0, 0, hm, hp), C12 = C.block(0, hp, hm, hp);
+    auto C21 = C.block(hm, 0, hm, hp), C22 = C.block(hm, hp, hm, hp);
 
-    for (int i = 0; i < h; i++)
+    MatrixView<T> TA{ws, hm, hn, hn};
+    MatrixView<T> TB{TA.data + (long)hm * hn, hn, hp, hp};
+    MatrixView<T> M{TB.data + (long)hn * hp, hm, hp, hp};
+    T *next = M.data + (long)hm * hp;
+
+    // M1 = (A11 + A22)(B11 + B22): C11 = M1, C22 = M1
+    add(A11, A22, TA);
+    add(B11, B22, TB);
+    strassen_rec(TA, TB, C11, next, cutoff);
+    copy_view(C11, C22);
+
+    // M2 = (A21 + A22) B11: C21 = M2, C22 -= M2
+    add(A21, A22, TA);
+    strassen_rec(TA, B11, C21, next, cutoff);
+    sub(C22, C21, C22);
+
+    // M3 = A11 (B12 - B22): C12 = M3, C22 += M3
+    sub(B12, B22, TB);
+    strassen_rec(A11, TB, C12, next, cutoff);
+    add(C22, C12, C22);
+
+    // M4 = A22 (B21 - B11): C11 += M4, C21 += M4
+    sub(B21, B11, TB);
+    strassen_rec(A22, TB, M, next, cutoff);
+    add(C11, M, C11);
+    add(C21, M, C21);
+
+    // M5 = (A11 + A12) B22: C11 -= M5, C12 += M5
+    add(A11, A12, TA);
+    strassen_rec(TA, B22, M, next, cutoff);
+    sub(C11, M, C11);
+    add(C12, M, C12);
+
+    // M6 = (A21 - A11)(B11 + B12): C22 += M6
+    sub(A21, A11, TA);
+    add(B11, B12, TB);
+    strassen_rec(TA, TB, M, next, cutoff);
+    add(C22, M, C22);
+
+    // M7 = (A12 - A22)(B21 + B22): C11 += M7
+    sub(A12, A22, TA);
+    add(B21, B22, TB);
+    strassen_rec(TA, TB, M, next, cutoff);
+    add(C11, M, C11);
+
+    if (n % 2)
+        gemm(A.data + n - 1, A.ld, B.data + (long)(n - 1) * B.ld, B.ld, C.data, C.ld, 2 * hm, 1, 2 * hp);
+    if (p % 2)
     {
-        for (int j = 0; j < h; j++)
-        {
-            A11[i * h + j] = A[i * m + j];
-            A12[i * h + j] = A[i * m + j + h];
-            A21[i * h + j] = A[(i + h) * m + j];
-            A22[i * h + j] = A[(i + h) * m + j + h];
-
-            B11[i * h + j] = B[i * m + j];
-            B12[i * h + j] = B[i * m + j + h];
-            B21[i * h + j] = B[(i + h) * m + j];
-            B22[i * h + j] = B[(i + h) * m + j + h];
-        }
+        zero_view(C.block(0, p - 1, 2 * hm, 1));
+        gemm(A.data, A.ld, B.data + p - 1, B.ld, C.data + p - 1, C.ld, 2 * hm, n, 1);
     }
-    auto M1 = multiply(add(A11, A22, h), add(B11, B22, h), h, h, h);
-    auto M2 = multiply(add(A21, A22, h), B11, h, h, h);
-    auto M3 = multiply(A11, sub(B12, B22, h), h, h, h);
-    auto M4 = multiply(A22, sub(B21, B11, h), h, h, h);
-    auto M5 = multiply(add(A11, A12, h), B22, h, h, h);
-    auto M6 = multiply(sub(A21, A11, h), add(B11, B12, h), h, h, h);
-    auto M7 = multiply(sub(A12, A22, h), add(B21, B22, h), h, h, h);
-
-    auto C11 = add(sub(add(M1, M4, h), M5, h), M7, h);
-    auto C12 = add(M3, M5, h);
-    auto C21 = add(M2, M4, h);
-    auto C22 = add(sub(add(M1, M3, h), M2, h), M6, h);
-
-    vector<double> C(m * m);
-    for (int i = 0; i < h; i++)
+    if (m % 2)
     {
-        for (int j = 0; j < h; j++)
-        {
-            C[i * m + j] = C11[i * h + j];
-            C[i * m + j + h] = C12[i * h + j];
-            C[(i + h) * m + j] = C21[i * h + j];
-            C[(i + h) * m + j + h] = C22[i * h + j];
-        }
+        zero_view(C.block(m - 1, 0, 1, p));
+        gemm(A.data + (long)(m - 1) * A.ld, A.ld, B.data, B.ld, C.data + (long)(m - 1) * C.ld, C.ld, 1, n, p);
     }
+}
 
+template <class T>
+static void strassen_run(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C, int cutoff)
+{
+    T *ws = workspace<T>(WS_STRASSEN, strassen_workspace(A.rows, A.cols, B.cols, cutoff));
+    strassen_rec(A, B, C, ws, cutoff);
+}
+
+int strassen_cutoff()
+{
+    static const int cutoff = tuned_cutoff(
+        "strassen_cutoff", 1024,
+        [](const vector<double> &A, const vector<double> &B, int s) { multiply(A, B, s, s, s); },
+        [](const vector<double> &A, const vector<double> &B, int s)
+        {
+            vector<double> C(s * s);
+            strassen_run<double>({A.data(), s, s, s}, {B.data(), s, s, s}, {C.data(), s, s, s}, s - 1);
+        });
+    return cutoff;
+}
+
+template <class T>
+void strassen(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C, int cutoff)
+{
+    strassen_run(A, B, C, cutoff);
+}
+
+template <class T>
+void strassen(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
+{
+    strassen_run(A, B, C, strassen_cutoff());
+}
+
+template <class T>
+vector<T> strassen(const vector<T> &A, const vector<T> &B, int m, int n, int p)
+{
+    vector<T> C(m * p);
+    strassen<T>({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p});
     return C;
-}
\ No newline at end of file
+}
+
+#define INSTANTIATE(T)                                                                \
+    template vector<T> strassen(const vector<T> &, const vector<T> &, int, int, int); \
+    template void strassen<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>);       \
+    template void strassen<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -1,236 +1,237 @@
-#include "matrix.h"
-#include <mpi.h>
+#include "strassen.h"
+#include "distribution.h"
+#include "trace.h"
 
-vector<double> strassen_mpi(const vector<double> &A, const vector<double> &B, int m, int n, int p, int rank, int size)
+// Which of the 7 products rank works on: consecutive groups of ranks whose
+// sizes differ by at most one
+static int strassen_group(int rank, int size)
 {
-    if (size < 7 && rank == 0)
-        throw runtime_error("Strassen requires at least 7 MPI processes");
-    int workers = min(size, 7);
-    if (rank >= workers)
+    int g = 0;
+    while (block_range(size, 7, g).second <= rank)
+        g++;
+    return g;
+}
+
+// Group whose leader reduces quadrant q of C and ships it to rank 0: the last
+// group adding into it, never group 0, so rank 0 does no summing
+static const int quadrant_owner[4] = {6, 4, 3, 5};
+
+// C = A * B over the ranks of comm, operands and result significant on its
+// rank 0 only. With 7 or more ranks one Strassen level splits them into 7
+// groups (BFS): every group leader receives the quadrants of its product, forms
+// the operands and the group recurses on its own communicator; rank 0 combines
+// the 7 products and peels the odd row/column/inner index. 2 to 6 ranks run
+// SUMMA, a single rank the local `product`.
+template <class T>
+static void strassen_comm(ConstMatrixView<T> A, ConstMatrixView<T> B, MatrixView<T> C, MPI_Comm comm, view_kernel<T> product, view_kernel<T> accumulate)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int m = A.rows, n = A.cols, p = B.cols;
+    int hm = m / 2, hn = n / 2, hp = p / 2;
+
+    if (size == 1)
     {
-        return vector<double>();
+        product(A, B, C);
+        return;
     }
-    int m_padded = next_pow2(m);
-    int n_padded = next_pow2(n);
-    int p_padded = next_pow2(p);
-    int N = max(m_padded, max(n_padded, p_padded));
-
-    int h = N / 2;
-    int hs = h * h;
-    vector<double> A11, A12, A21, A22;
-    vector<double> B11, B12, B21, B22;
-    vector<double> A_pad, B_pad;
-    if (rank == 0)
+    if (size < 7 || min(hm, min(hn, hp)) == 0)
     {
-        A_pad.assign(N * N, 0.0);
-        B_pad.assign(N * N, 0.0);
-
-        // Copy A (m x n)
-        for (int i = 0; i < m; i++)
-            for (int j = 0; j < n; j++)
-                A_pad[i * N + j] = A[i * n + j];
-
-        // Copy B (n x p)
-        for (int i = 0; i < n; i++)
-            for (int j = 0; j < p; j++)
-                B_pad[i * N + j] = B[i * p + j];
-
-        A11.resize(hs);
-        A12.resize(hs);
-        A21.resize(hs);
-        A22.resize(hs);
-        B11.resize(hs);
-        B12.resize(hs);
-        B21.resize(hs);
-        B22.resize(hs);
-
-        for (int i = 0; i < h; i++)
-        {
-            for (int j = 0; j < h; j++)
-            {
-                A11[i * h + j] = A_pad[i * N + j];
-                A12[i * h + j] = A_pad[i * N + j + h];
-                A21[i * h + j] = A_pad[(i + h) * N + j];
-                A22[i * h + j] = A_pad[(i + h) * N + j + h];
-
-                B11[i * h + j] = B_pad[i * N + j];
-                B12[i * h + j] = B_pad[i * N + j + h];
-                B21[i * h + j] = B_pad[(i + h) * N + j];
-                B22[i * h + j] = B_pad[(i + h) * N + j + h];
-            }
-        }
+        ProcGrid grid = plan_grid(m, p, size, comm);
+        DistMatrix<T> A_local = scatter_matrix(A, {m, n, grid}, 0, rank);
+        DistMatrix<T> B_local = scatter_matrix(B, {n, p, grid}, 0, rank);
+        gather_matrix(multiply_distributed(A_local, B_local, accumulate), 0, C);
+        return;
     }
-    vector<double> local_M(hs, 0.0);
 
-    if (rank == 0)
+    int group = strassen_group(rank, size), leader = block_range(size, 7, group).first;
+    bool is_leader = rank == leader;
+    const StrassenProduct &prod = strassen_products[group];
+    MPI_Comm group_comm;
+    MPI_Comm_split(comm, group, rank, &group_comm);
+
+    // rank 0 and the leaders of the groups that read quadrant q of A (q) or
+    // of B (4 + q); the leaders of the groups that add into quadrant q of C
+    // (8 + q), with the quadrant's owner first
+    MPI_Comm quad_comm[12];
+    for (int i = 0; i < 12; i++)
     {
-        MPI_Send(A21.data(), hs, MPI_DOUBLE, 1, TAG_A21, MPI_COMM_WORLD);
-        MPI_Send(A22.data(), hs, MPI_DOUBLE, 1, TAG_A22, MPI_COMM_WORLD);
-        MPI_Send(B11.data(), hs, MPI_DOUBLE, 1, TAG_B11, MPI_COMM_WORLD);
-
-        MPI_Send(A11.data(), hs, MPI_DOUBLE, 2, TAG_A11, MPI_COMM_WORLD);
-        MPI_Send(B12.data(), hs, MPI_DOUBLE, 2, TAG_B12, MPI_COMM_WORLD);
-        MPI_Send(B22.data(), hs, MPI_DOUBLE, 2, TAG_B22, MPI_COMM_WORLD);
-
-        MPI_Send(A22.data(), hs, MPI_DOUBLE, 3, TAG_A22, MPI_COMM_WORLD);
-        MPI_Send(B21.data(), hs, MPI_DOUBLE, 3, TAG_B21, MPI_COMM_WORLD);
-        MPI_Send(B11.data(), hs, MPI_DOUBLE, 3, TAG_B11, MPI_COMM_WORLD);
-
-        MPI_Send(A11.data(), hs, MPI_DOUBLE, 4, TAG_A11, MPI_COMM_WORLD);
-        MPI_Send(A12.data(), hs, MPI_DOUBLE, 4, TAG_A12, MPI_COMM_WORLD);
-        MPI_Send(B22.data(), hs, MPI_DOUBLE, 4, TAG_B22, MPI_COMM_WORLD);
-
-        MPI_Send(A21.data(), hs, MPI_DOUBLE, 5, TAG_A21, MPI_COMM_WORLD);
-        MPI_Send(A11.data(), hs, MPI_DOUBLE, 5, TAG_A11, MPI_COMM_WORLD);
-        MPI_Send(B11.data(), hs, MPI_DOUBLE, 5, TAG_B11, MPI_COMM_WORLD);
-        MPI_Send(B12.data(), hs, MPI_DOUBLE, 5, TAG_B12, MPI_COMM_WORLD);
-
-        MPI_Send(A12.data(), hs, MPI_DOUBLE, 6, TAG_A12, MPI_COMM_WORLD);
-        MPI_Send(A22.data(), hs, MPI_DOUBLE, 6, TAG_A22, MPI_COMM_WORLD);
-        MPI_Send(B21.data(), hs, MPI_DOUBLE, 6, TAG_B21, MPI_COMM_WORLD);
-        MPI_Send(B22.data(), hs, MPI_DOUBLE, 6, TAG_B22, MPI_COMM_WORLD);
-        local_M = multiply(add(A11, A22, h), add(B11, B22, h), h, h, h);
-        A11.clear();
-        A11.shrink_to_fit();
-        A22.clear();
-        A22.shrink_to_fit();
-        B11.clear();
-        B11.shrink_to_fit();
-        B22.clear();
-        B22.shrink_to_fit();
+        int q = i % 4;
+        bool uses = i < 4 ? prod.a.first == q || prod.a.second == q : i < 8 ? prod.b.first == q || prod.b.second == q : strassen_combine[group][q] != 0;
+        bool member = is_leader && uses;
+        if (i < 8)
+            member = member || rank == 0;
+        int key = i >= 8 && group == quadrant_owner[q] ? -1 : rank;
+        MPI_Comm_split(comm, member ? 0 : MPI_UNDEFINED, key, &quad_comm[i]);
     }
 
-    else if (rank == 1)
+    // operands and product of this group, held by its leader, with the
+    // received quadrants behind them
+    long size_A = (long)hm * hn, size_B = (long)hn * hp;
+    vector<T> buf;
+    MatrixView<T> TA_v{nullptr, hm, hn, hn}, TB_v{nullptr, hn, hp, hp}, M_v{nullptr, hm, hp, hp};
+    ConstMatrixView<T> TA = TA_v, TB = TB_v;
+    ConstMatrixView<T> qA[4], qB[4];
+    if (is_leader)
     {
-        // M2 = (A21 + A22) * B11
-        A21.resize(hs);
-        A22.resize(hs);
-        B11.resize(hs);
-        MPI_Recv(A21.data(), hs, MPI_DOUBLE, 0, TAG_A21, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(A22.data(), hs, MPI_DOUBLE, 0, TAG_A22, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B11.data(), hs, MPI_DOUBLE, 0, TAG_B11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        local_M = multiply(add(A21, A22, h), B11, h, h, h);
+        buf.resize(3 * size_A + 3 * size_B + (long)hm * hp);
+        TA_v.data = buf.data();
+        TB_v.data = TA_v.data + size_A;
+        M_v.data = TB_v.data + size_B;
     }
-    else if (rank == 2)
-    {
-        A11.resize(hs);
-        B12.resize(hs);
-        B22.resize(hs);
 
-        MPI_Recv(A11.data(), hs, MPI_DOUBLE, 0, TAG_A11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B12.data(), hs, MPI_DOUBLE, 0, TAG_B12, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B22.data(), hs, MPI_DOUBLE, 0, TAG_B22, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        local_M = multiply(A11, sub(B12, B22, h), h, h, h);
-    }
-    else if (rank == 3)
+    // operand fan-out: every quadrant goes out once, as one broadcast to the
+    // leaders that need it, all eight in flight while rank 0 computes M1;
+    // rank 0 broadcasts straight out of A and B through strided datatypes
+    MPI_Request fan_out[8];
+    T *recv = is_leader ? M_v.data + (long)hm * hp : nullptr;
+    for (int i = 0; i < 8; i++)
     {
-        A22.resize(hs);
-        B21.resize(hs);
-        B11.resize(hs);
-
-        MPI_Recv(A22.data(), hs, MPI_DOUBLE, 0, TAG_A22, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B21.data(), hs, MPI_DOUBLE, 0, TAG_B21, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B11.data(), hs, MPI_DOUBLE, 0, TAG_B11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        local_M = multiply(A22, sub(B21, B11, h), h, h, h);
+        int q = i % 4, rows = i < 4 ? hm : hn, cols = i < 4 ? hn : hp;
+        ConstMatrixView<T> *quads = i < 4 ? qA : qB;
+        fan_out[i] = MPI_REQUEST_NULL;
+        if (quad_comm[i] == MPI_COMM_NULL)
+            continue;
+        if (rank == 0)
+        {
+            quads[q] = quadrant(i < 4 ? A : B, q, rows, cols);
+            MPI_Datatype type = block_type<T>(rows, cols, quads[q].ld);
+            MPI_Ibcast(const_cast<T *>(quads[q].data), 1, type, 0, quad_comm[i], &fan_out[i]);
+            MPI_Type_free(&type);
+        }
+        else
+        {
+            quads[q] = {recv, rows, cols, cols};
+            MPI_Ibcast(recv, rows * cols, mpi_type<T>(), 0, quad_comm[i], &fan_out[i]);
+            recv += (long)rows * cols;
+        }
     }
-    else if (rank == 4)
+    // the finished quadrants land straight in C, unpacked by MPI
+    MPI_Request assembled[4];
+    for (int q = 0; q < 4; q++)
     {
-        A11.resize(hs);
-        A12.resize(hs);
-        B22.resize(hs);
-
-        MPI_Recv(A11.data(), hs, MPI_DOUBLE, 0, TAG_A11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(A12.data(), hs, MPI_DOUBLE, 0, TAG_A12, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B22.data(), hs, MPI_DOUBLE, 0, TAG_B22, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        local_M = multiply(add(A11, A12, h), B22, h, h, h);
+        assembled[q] = MPI_REQUEST_NULL;
+        if (rank != 0)
+            continue;
+        MatrixView<T> Cq = quadrant(C, q, hm, hp);
+        MPI_Datatype type = block_type<T>(hm, hp, Cq.ld);
+        MPI_Irecv(Cq.data, 1, type, block_range(size, 7, quadrant_owner[q]).first, TAG_RESULT + q, comm, &assembled[q]);
+        MPI_Type_free(&type);
     }
-    else if (rank == 5)
-    {
-        A21.resize(hs);
-        A11.resize(hs);
-        B11.resize(hs);
-        B12.resize(hs);
-
-        MPI_Recv(A21.data(), hs, MPI_DOUBLE, 0, TAG_A21, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(A11.data(), hs, MPI_DOUBLE, 0, TAG_A11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B11.data(), hs, MPI_DOUBLE, 0, TAG_B11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B12.data(), hs, MPI_DOUBLE, 0, TAG_B12, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
-        local_M = multiply(sub(A21, A11, h), add(B11, B12, h), h, h, h);
-    }
-    else if (rank == 6)
+    if (is_leader)
     {
-        A12.resize(hs);
-        A22.resize(hs);
-        B21.resize(hs);
-        B22.resize(hs);
-
-        MPI_Recv(A12.data(), hs, MPI_DOUBLE, 0, TAG_A12, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(A22.data(), hs, MPI_DOUBLE, 0, TAG_A22, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B21.data(), hs, MPI_DOUBLE, 0, TAG_B21, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(B22.data(), hs, MPI_DOUBLE, 0, TAG_B22, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        local_M = multiply(sub(A12, A22, h), add(B21, B22, h), h, h, h);
+        if (rank != 0)
+        {
+            TRACE_SCOPE(TRACE_COMM, "fan_out");
+            MPI_Waitall(8, fan_out, MPI_STATUSES_IGNORE);
+        }
+        TA = form_operand(prod.a, qA, TA_v);
+        TB = form_operand(prod.b, qB, TB_v);
     }
 
-    vector<double> M1, M2, M3, M4, M5, M6, M7;
-
-    if (rank == 0)
+    strassen_comm<T>(TA, TB, M_v, group_comm, product, accumulate);
+    MPI_Comm_free(&group_comm);
     {
-        M1.resize(hs);
-        M2.resize(hs);
-        M3.resize(hs);
-        M4.resize(hs);
-        M5.resize(hs);
-        M6.resize(hs);
-        M7.resize(hs);
-        M1 = local_M;
-        MPI_Recv(M2.data(), hs, MPI_DOUBLE, 1, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(M3.data(), hs, MPI_DOUBLE, 2, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(M4.data(), hs, MPI_DOUBLE, 3, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(M5.data(), hs, MPI_DOUBLE, 4, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(M6.data(), hs, MPI_DOUBLE, 5, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(M7.data(), hs, MPI_DOUBLE, 6, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        TRACE_SCOPE(TRACE_COMM, "fan_out");
+        MPI_Waitall(8, fan_out, MPI_STATUSES_IGNORE);
     }
-    else if (rank >= 1 && rank <= 6)
+
+    // result fan-in: the leaders adding into quadrant q of C reduce their
+    // signed M into the quadrant's owner, which sends the sum on to rank 0.
+    // An added M goes out as is; a subtracted one, and the owner's sum unless
+    // M feeds no other quadrant, take a buffer of their own
+    int feeds = 0;
+    for (int q = 0; q < 4; q++)
+        feeds += strassen_combine[group][q] != 0;
+    auto own_buffer = [&](int q)
     {
-        MPI_Send(local_M.data(), hs, MPI_DOUBLE, 0, TAG_RESULT, MPI_COMM_WORLD);
+        return strassen_combine[group][q] < 0 || (group == quadrant_owner[q] && feeds > 1);
+    };
+    MPI_Request fan_in[4];
+    const T *sum[4] = {};
+    vector<T> parts;
+    if (is_leader)
+    {
+        int buffers = 0;
+        for (int q = 0; q < 4; q++)
+            buffers += strassen_combine[group][q] != 0 && own_buffer(q);
+        parts.resize(buffers * (long)hm * hp);
     }
-
-    vector<double> C, C_pad;
-
-    if (rank == 0)
+    T *next = parts.data();
+    for (int q = 0; q < 4; q++)
     {
-        C_pad.resize(N * N);
-        // C11 = M1 + M4 - M5 + M7
-        auto C11 = add(sub(add(M1, M4, h), M5, h), M7, h);
-        // C12 = M3 + M5
-        auto C12 = add(M3, M5, h);
-        // C21 = M2 + M4
-        auto C21 = add(M2, M4, h);
-        // C22 = M1 + M3 - M2 + M6
-        auto C22 = add(sub(add(M1, M3, h), M2, h), M6, h);
-
-        for (int i = 0; i < h; i++)
+        fan_in[q] = MPI_REQUEST_NULL;
+        if (quad_comm[8 + q] == MPI_COMM_NULL)
+            continue;
+        T *send = M_v.data, *recv = M_v.data;
+        if (own_buffer(q))
         {
-            for (int j = 0; j < h; j++)
+            MatrixView<T> part{next, hm, hp, hp};
+            next += (long)hm * hp;
+            recv = part.data;
+            if (strassen_combine[group][q] < 0)
             {
-                C_pad[i * N + j] = C11[i * h + j];
-                C_pad[i * N + j + h] = C12[i * h + j];
-                C_pad[(i + h) * N + j] = C21[i * h + j];
-                C_pad[(i + h) * N + j + h] = C22[i * h + j];
+                TRACE_SCOPE(TRACE_COMBINE, "signed_part");
+                copy_view(M_v, part);
+                scale_view(part, T(-1));
+                send = part.data;
             }
         }
-
-        C.resize(m * p);
-
-        for (int i = 0; i < m; i++)
-            for (int j = 0; j < p; j++)
-                C[i * p + j] = C_pad[i * N + j];
+        if (group == quadrant_owner[q])
+        {
+            MPI_Ireduce(send == recv ? MPI_IN_PLACE : send, recv, hm * hp, mpi_type<T>(), MPI_SUM, 0, quad_comm[8 + q], &fan_in[q]);
+            sum[q] = recv;
+        }
+        else
+            MPI_Ireduce(send, nullptr, hm * hp, mpi_type<T>(), MPI_SUM, 0, quad_comm[8 + q], &fan_in[q]);
+    }
+    {
+        TRACE_SCOPE(TRACE_COMM, "fan_in");
+        MPI_Waitall(4, fan_in, MPI_STATUSES_IGNORE);
+        for (int q = 0; q < 4; q++)
+            if (sum[q])
+                MPI_Send(sum[q], hm * hp, mpi_type<T>(), 0, TAG_RESULT + q, comm);
+    }
+    for (MPI_Comm &c : quad_comm)
+        if (c != MPI_COMM_NULL)
+            MPI_Comm_free(&c);
+    if (rank != 0)
+        return;
+    {
+        TRACE_SCOPE(TRACE_COMM, "assemble");
+        MPI_Waitall(4, assembled, MPI_STATUSES_IGNORE);
     }
 
+    // the odd inner index is a rank-1 update of every quadrant, accumulated in place
+    TRACE_SCOPE(TRACE_COMBINE, "odd_peel");
+    if (n % 2)
+    {
+        for (int q = 0; q < 4; q++)
+            accumulate(A.block(q / 2 * hm, n - 1, hm, 1), B.block(n - 1, q % 2 * hp, 1, hp), quadrant(C, q, hm, hp));
+    }
+    if (p % 2)
+        product(A.block(0, 0, 2 * hm, n), B.block(0, p - 1, n, 1), C.block(0, p - 1, 2 * hm, 1));
+    if (m % 2)
+        product(A.block(m - 1, 0, 1, n), B, C.block(m - 1, 0, 1, p));
+}
+
+template <class T>
+vector<T> strassen_distributed(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int /*size*/, view_kernel<T> product, view_kernel<T> accumulate)
+{
+    vector<T> C(rank == 0 ? (long)m * p : 0);
+    strassen_comm<T>({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p}, MPI_COMM_WORLD, product, accumulate);
     return C;
-}
\ No newline at end of file
+}
+
+template <class T>
+vector<T> strassen_mpi(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size)
+{
+    return strassen_distributed(A, B, m, n, p, rank, size, strassen<T>, multiply_add<T>);
+}
+
+#define INSTANTIATE(T)                                                                                                                       \
+    template vector<T> strassen_distributed(const vector<T> &, const vector<T> &, int, int, int, int, int, view_kernel<T>, view_kernel<T>); \
+    template vector<T> strassen_mpi(const vector<T> &, const vector<T> &, int, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
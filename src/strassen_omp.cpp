@@ -1,58 +1,240 @@
 #include "matrix.h"
+#include "gemm.h"
+#include "workspace.h"
+#include "strassen.h"
+#include "trace.h"
 #include <omp.h>
 
-vector<double> strassen_omp(const vector<double> &A, const vector<double> &B, int m, int n, int p)
+// M1, M2 and M3 are computed straight into the C quadrant they open
+// (C11, C21, C12); M4..M7 get scratch blocks.
+static const int resident_quadrant[7] = {0, 2, 1, -1, -1, -1, -1};
+
+// Scratch of one task level: a sum buffer for every operand that is not a
+// single quadrant, the M4..M7 blocks, and the regions of the seven child levels.
+static long task_level_size(int hm, int hn, int hp)
 {
-    if (m <= THRESHOLD || m != n || n != p)
+    long size = 0;
+    for (int k = 0; k < 7; k++)
     {
-        return multiply_omp(A, B, m, n, p);
+        if (strassen_products[k].a.second >= 0)
+            size += (long)hm * hn;
+        if (strassen_products[k].b.second >= 0)
+            size += (long)hn * hp;
+        if (resident_quadrant[k] < 0)
+            size += (long)hm * hp;
     }
+    return size;
+}
 
-    int h = m / 2;
-    int hs = h * h;
+static long task_workspace(int m, int n, int p, int depth, int cutoff)
+{
+    if (depth == 0 || min(m, min(n, p)) <= cutoff)
+        return 0;
+    int hm = m / 2, hn = n / 2, hp = p / 2;
+    return task_level_size(hm, hn, hp) + 7 * task_workspace(hm, hn, hp, depth - 1, cutoff);
+}
 
-    vector<double> A11(hs), A12(hs), A21(hs), A22(hs);
-    vector<double> B11(hs), B12(hs), B21(hs), B22(hs);
+// Cq = sum of its signed M terms; a resident M is already in place, C22 starts from a copy of M1
+template <class T>
+static void combine_quadrant(int q, MatrixView<T> Cq, const MatrixView<T> M[7])
+{
+    TRACE_SCOPE(TRACE_COMBINE, "combine_quadrant");
+    bool started = false;
+    for (int k = 0; k < 7; k++)
+    {
+        if (resident_quadrant[k] == q)
+            started = true;
+    }
+    for (int k = 0; k < 7; k++)
+    {
+        int sign = strassen_combine[k][q];
+        if (sign == 0 || resident_quadrant[k] == q)
+            continue;
+        if (!started)
+            copy_view(M[k], Cq);
+        else if (sign > 0)
+            add(Cq, M[k], Cq);
+        else
+            sub(Cq, M[k], Cq);
+        started = true;
+    }
+}
+
+// C = A * B as a task graph: operand sums, the seven products and the four
+// quadrant combines are tasks ordered by dependencies, products recurse as
+// tasks for `depth` more levels and then run the serial Strassen.
+// Must be called from inside a parallel region.
+template <class T>
+static void strassen_task(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C, T *ws, int depth, int cutoff)
+{
+    int m = A.rows, n = A.cols, p = B.cols;
+    if (depth == 0 || min(m, min(n, p)) <= cutoff)
+    {
+        strassen<T>(A, B, C, cutoff);
+        return;
+    }
+
+    int hm = m / 2, hn = n / 2, hp = p / 2;
+    ConstMatrixView<T> qA[4], qB[4];
+    MatrixView<T> qC[4];
+    for (int q = 0; q < 4; q++)
+    {
+        qA[q] = quadrant(A, q, hm, hn);
+        qB[q] = quadrant(B, q, hn, hp);
+        qC[q] = quadrant(C, q, hm, hp);
+    }
 
-    for (int i = 0; i < h; i++)
+    MatrixView<T> TA[7], TB[7], M[7];
+    T *ta[7], *tb[7], *mk[7];
+    T *next = ws;
+    for (int k = 0; k < 7; k++)
     {
-        for (int j = 0; j < h; j++)
+        const StrassenProduct &prod = strassen_products[k];
+        TA[k] = {next, hm, hn, hn};
+        next += prod.a.second >= 0 ? (long)hm * hn : 0;
+        TB[k] = {next, hn, hp, hp};
+        next += prod.b.second >= 0 ? (long)hn * hp : 0;
+        if (resident_quadrant[k] >= 0)
+            M[k] = qC[resident_quadrant[k]];
+        else
         {
-            A11[i * h + j] = A[i * m + j];
-            A12[i * h + j] = A[i * m + j + h];
-            A21[i * h + j] = A[(i + h) * m + j];
-            A22[i * h + j] = A[(i + h) * m + j + h];
-
-            B11[i * h + j] = B[i * m + j];
-            B12[i * h + j] = B[i * m + j + h];
-            B21[i * h + j] = B[(i + h) * m + j];
-            B22[i * h + j] = B[(i + h) * m + j + h];
+            M[k] = {next, hm, hp, hp};
+            next += (long)hm * hp;
         }
+        ta[k] = prod.a.second >= 0 ? TA[k].data : const_cast<T *>(qA[prod.a.first].data);
+        tb[k] = prod.b.second >= 0 ? TB[k].data : const_cast<T *>(qB[prod.b.first].data);
+        mk[k] = M[k].data;
     }
-    auto M1 = multiply_omp(add(A11, A22, h), add(B11, B22, h), h, h, h);
-    auto M2 = multiply_omp(add(A21, A22, h), B11, h, h, h);
-    auto M3 = multiply_omp(A11, sub(B12, B22, h), h, h, h);
-    auto M4 = multiply_omp(A22, sub(B21, B11, h), h, h, h);
-    auto M5 = multiply_omp(add(A11, A12, h), B22, h, h, h);
-    auto M6 = multiply_omp(sub(A21, A11, h), add(B11, B12, h), h, h, h);
-    auto M7 = multiply_omp(sub(A12, A22, h), add(B21, B22, h), h, h, h);
-
-    auto C11 = add(sub(add(M1, M4, h), M5, h), M7, h);
-    auto C12 = add(M3, M5, h);
-    auto C21 = add(M2, M4, h);
-    auto C22 = add(sub(add(M1, M3, h), M2, h), M6, h);
+    long child = task_workspace(hm, hn, hp, depth - 1, cutoff);
 
-    vector<double> C(m * m);
-    for (int i = 0; i < h; i++)
+    for (int k = 0; k < 7; k++)
     {
-        for (int j = 0; j < h; j++)
+        const StrassenProduct &prod = strassen_products[k];
+        if (prod.a.second >= 0)
+        {
+            #pragma omp task depend(out : ta[k][0])
+            form_operand(prod.a, qA, TA[k]);
+        }
+        if (prod.b.second >= 0)
         {
-            C[i * m + j] = C11[i * h + j];
-            C[i * m + j + h] = C12[i * h + j];
-            C[(i + h) * m + j] = C21[i * h + j];
-            C[(i + h) * m + j + h] = C22[i * h + j];
+            #pragma omp task depend(out : tb[k][0])
+            form_operand(prod.b, qB, TB[k]);
         }
+
+        ConstMatrixView<T> opA = prod.a.second >= 0 ? ConstMatrixView<T>(TA[k]) : qA[prod.a.first];
+        ConstMatrixView<T> opB = prod.b.second >= 0 ? ConstMatrixView<T>(TB[k]) : qB[prod.b.first];
+        T *child_ws = next + k * child;
+        #pragma omp task depend(in : ta[k][0], tb[k][0]) depend(out : mk[k][0])
+        strassen_task<T>(opA, opB, M[k], child_ws, depth - 1, cutoff);
     }
 
+    // C22 reads M1..M3 out of C11, C21, C12, so it is queued before their combines.
+    // The odd inner index adds a rank-1 update to each quadrant once it is combined.
+    #pragma omp task depend(in : mk[0][0], mk[1][0], mk[2][0], mk[5][0])
+    {
+        combine_quadrant(3, qC[3], M);
+        if (n % 2)
+            gemm(A.data + (long)hm * A.ld + n - 1, A.ld, B.data + (long)(n - 1) * B.ld + hp, B.ld, qC[3].data, C.ld, hm, 1, hp);
+    }
+    #pragma omp task depend(inout : mk[0][0]) depend(in : mk[3][0], mk[4][0], mk[6][0])
+    {
+        combine_quadrant(0, qC[0], M);
+        if (n % 2)
+            gemm(A.data + n - 1, A.ld, B.data + (long)(n - 1) * B.ld, B.ld, qC[0].data, C.ld, hm, 1, hp);
+    }
+    #pragma omp task depend(inout : mk[2][0]) depend(in : mk[4][0])
+    {
+        combine_quadrant(1, qC[1], M);
+        if (n % 2)
+            gemm(A.data + n - 1, A.ld, B.data + (long)(n - 1) * B.ld + hp, B.ld, qC[1].data, C.ld, hm, 1, hp);
+    }
+    #pragma omp task depend(inout : mk[1][0]) depend(in : mk[3][0])
+    {
+        combine_quadrant(2, qC[2], M);
+        if (n % 2)
+            gemm(A.data + (long)hm * A.ld + n - 1, A.ld, B.data + (long)(n - 1) * B.ld, B.ld, qC[2].data, C.ld, hm, 1, hp);
+    }
+
+    // the odd column and row of C do not overlap the quadrants
+    if (p % 2)
+    {
+        #pragma omp task
+        multiply<T>(A.block(0, 0, 2 * hm, n), B.block(0, p - 1, n, 1), C.block(0, p - 1, 2 * hm, 1));
+    }
+    if (m % 2)
+    {
+        #pragma omp task
+        multiply<T>(A.block(m - 1, 0, 1, n), B, C.block(m - 1, 0, 1, p));
+    }
+
+    #pragma omp taskwait
+}
+
+// Enough task levels for 7^depth >= 2 * threads products to balance over the team
+static int task_depth()
+{
+    int depth = 1;
+    for (long tasks = 7; tasks < 2L * omp_get_max_threads(); tasks *= 7)
+        depth++;
+    return depth;
+}
+
+template <class T>
+static void strassen_omp_run(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C, int cutoff)
+{
+    int depth = task_depth();
+    T *ws = workspace<T>(WS_STRASSEN_TASKS, task_workspace(A.rows, A.cols, B.cols, depth, cutoff));
+
+    #pragma omp parallel
+    #pragma omp single
+    strassen_task<T>(A, B, C, ws, depth, cutoff);
+}
+
+int strassen_omp_cutoff()
+{
+    static const int cutoff = tuned_cutoff(
+        "strassen_omp_cutoff", 1024,
+        [](const vector<double> &A, const vector<double> &B, int s) { multiply_omp(A, B, s, s, s); },
+        [](const vector<double> &A, const vector<double> &B, int s)
+        {
+            vector<double> C(s * s);
+            strassen_omp_run<double>({A.data(), s, s, s}, {B.data(), s, s, s}, {C.data(), s, s, s}, strassen_cutoff());
+        });
+    return cutoff;
+}
+
+template <class T>
+void strassen_omp(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C, int cutoff)
+{
+    if (min(A.rows, min(A.cols, B.cols)) <= cutoff)
+    {
+        multiply_omp<T>(A, B, C);
+        return;
+    }
+    strassen_omp_run<T>(A, B, C, cutoff);
+}
+
+template <class T>
+void strassen_omp(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
+{
+    if (min(A.rows, min(A.cols, B.cols)) <= strassen_omp_cutoff())
+    {
+        multiply_omp<T>(A, B, C);
+        return;
+    }
+    strassen_omp_run<T>(A, B, C, strassen_cutoff());
+}
+
+template <class T>
+vector<T> strassen_omp(const vector<T> &A, const vector<T> &B, int m, int n, int p)
+{
+    vector<T> C(m * p);
+    strassen_omp<T>({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p});
     return C;
-}
\ No newline at end of file
+}
+
+#define INSTANTIATE(T)                                                                    \
+    template vector<T> strassen_omp(const vector<T> &, const vector<T> &, int, int, int); \
+    template void strassen_omp<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>);       \
+    template void strassen_omp<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
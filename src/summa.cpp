@@ -0,0 +1,108 @@
+#include "distribution.h"
+#include "gemm.h"
+#include "trace.h"
+
+// Block that holds index k of a dimension of n split into `parts`
+static int block_owner(int n, int parts, int k)
+{
+    int idx = (int)((long)k * parts / n);
+    while (block_range(n, parts, idx).second <= k)
+        idx++;
+    while (block_range(n, parts, idx).first > k)
+        idx--;
+    return idx;
+}
+
+// Local step: rank (i, j) holds A(I_i, K_j), B(K_i, J_j) and C(I_i, J_j).
+// K panels never straddle a block of either split of n, so each panel of A
+// has one owner column and each panel of B one owner row.
+template <class T>
+static void summa(ConstMatrixView<T> A, ConstMatrixView<T> B, MatrixView<T> C, int n, ProcGrid grid, int my_row, int my_col, MPI_Comm row_comm, MPI_Comm col_comm, view_kernel<T> product)
+{
+    int panel = blocking().kc;
+    vector<T> A_buf(C.rows * panel), B_buf(panel * C.cols);
+
+    for (int k = 0; k < n;)
+    {
+        int a_owner = block_owner(n, grid.cols, k), b_owner = block_owner(n, grid.rows, k);
+        int a0 = block_range(n, grid.cols, a_owner).first, a1 = block_range(n, grid.cols, a_owner).second;
+        int b0 = block_range(n, grid.rows, b_owner).first, b1 = block_range(n, grid.rows, b_owner).second;
+        int kw = min(panel, min(a1 - k, b1 - k));
+
+        // the owners broadcast straight out of their blocks, the others receive
+        // contiguously; a grid row (column) with no rows (columns) of C skips its
+        // broadcast altogether, every member of the communicator agreeing on that
+        ConstMatrixView<T> A_panel{A_buf.data(), C.rows, kw, kw};
+        ConstMatrixView<T> B_panel{B_buf.data(), kw, C.cols, C.cols};
+        {
+            TRACE_SCOPE(TRACE_COMM, "bcast_panels");
+            if (C.rows > 0 && my_col == a_owner)
+            {
+                A_panel = A.block(0, k - a0, C.rows, kw);
+                MPI_Datatype type = block_type<T>(C.rows, kw, A.ld);
+                MPI_Bcast(const_cast<T *>(A_panel.data), 1, type, a_owner, row_comm);
+                MPI_Type_free(&type);
+            }
+            else if (C.rows > 0)
+            {
+                MPI_Bcast(A_buf.data(), C.rows * kw, mpi_type<T>(), a_owner, row_comm);
+            }
+
+            if (C.cols > 0 && my_row == b_owner)
+            {
+                B_panel = B.block(k - b0, 0, kw, C.cols);
+                MPI_Datatype type = block_type<T>(kw, C.cols, B.ld);
+                MPI_Bcast(const_cast<T *>(B_panel.data), 1, type, b_owner, col_comm);
+                MPI_Type_free(&type);
+            }
+            else if (C.cols > 0)
+            {
+                MPI_Bcast(B_buf.data(), kw * C.cols, mpi_type<T>(), b_owner, col_comm);
+            }
+        }
+
+        product(A_panel, B_panel, C);
+        k += kw;
+    }
+}
+
+template <class T>
+DistMatrix<T> multiply_distributed(const DistMatrix<T> &A, const DistMatrix<T> &B, view_kernel<T> product)
+{
+    ProcGrid grid = A.dist.grid;
+    if (!(B.dist.grid == grid) || A.dist.cols != B.dist.rows || A.rank != B.rank)
+        throw invalid_argument("multiply_distributed: A and B must share the process grid and the inner dimension");
+
+    int rank = A.rank, my_row = rank / grid.cols, my_col = rank % grid.cols;
+    MPI_Comm row_comm, col_comm;
+    MPI_Comm_split(grid.comm, my_row, my_col, &row_comm);
+    MPI_Comm_split(grid.comm, my_col, my_row, &col_comm);
+
+    DistMatrix<T> C = make_distributed<T>({A.dist.rows, B.dist.cols, grid}, rank);
+    summa<T>(A.view(), B.view(), C.view(), A.dist.cols, grid, my_row, my_col, row_comm, col_comm, product);
+
+    MPI_Comm_free(&row_comm);
+    MPI_Comm_free(&col_comm);
+    return C;
+}
+
+template <class T>
+vector<T> summa_distributed(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size, view_kernel<T> product)
+{
+    ProcGrid grid = plan_grid(m, p, size);
+    DistMatrix<T> A_local = scatter_matrix(A, {m, n, grid}, 0, rank);
+    DistMatrix<T> B_local = scatter_matrix(B, {n, p, grid}, 0, rank);
+    return gather_matrix(multiply_distributed(A_local, B_local, product), 0);
+}
+
+template <class T>
+vector<T> multiply_summa(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size)
+{
+    return summa_distributed(A, B, m, n, p, rank, size, multiply_add<T>);
+}
+
+#define INSTANTIATE(T)                                                                                                    \
+    template DistMatrix<T> multiply_distributed(const DistMatrix<T> &, const DistMatrix<T> &, view_kernel<T>);             \
+    template vector<T> summa_distributed(const vector<T> &, const vector<T> &, int, int, int, int, int, view_kernel<T>); \
+    template vector<T> multiply_summa(const vector<T> &, const vector<T> &, int, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -0,0 +1,131 @@
+#include "distribution.h"
+#include "trace.h"
+#include <cstdlib>
+#include <unistd.h>
+
+// The busiest rank is the leader of a layer other than 0: its blocks of A, B
+// and of its layer's copy of C (c layers hold A and B once between them but C
+// c times over), and, until they are scattered, the whole K slices of A and B
+// it receives. Rank 0 holds A and B as the caller's input whatever c is, and
+// layer 0 scatters straight out of them.
+int plan_layers(int m, int n, int p, int size, double memory, int element_size)
+{
+    int best = 1;
+    for (int c = 2; (long)c * c * c <= size && c <= n; c++)
+    {
+        if (size % c)
+            continue;
+        double slices = ((double)m + p) * ((n + c - 1) / c);
+        double blocks = ((double)m * n + (double)n * p + (double)c * m * p) / size;
+        if ((slices + blocks) * element_size <= memory)
+            best = c;
+    }
+    return best;
+}
+
+double rank_memory(MPI_Comm comm)
+{
+    double memory;
+    if (const char *forced = getenv("MATMUL_RANK_MEMORY"))
+        memory = atof(forced);
+    else
+    {
+        MPI_Comm node_comm;
+        int node_size;
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+        MPI_Comm_size(node_comm, &node_size);
+        MPI_Comm_free(&node_comm);
+#ifdef _SC_AVPHYS_PAGES
+        long pages = sysconf(_SC_AVPHYS_PAGES);
+#else
+        long pages = sysconf(_SC_PHYS_PAGES) / 2;
+#endif
+        memory = (double)pages * sysconf(_SC_PAGE_SIZE) / node_size;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &memory, 1, MPI_DOUBLE, MPI_MIN, comm);
+    return memory;
+}
+
+// Layer l of c owns K slice l of the inner dimension: rank 0 sends the leader
+// of every other layer its columns of A and rows of B, and each layer scatters
+// its slices over its own grid. Layer 0 works straight out of A and B.
+template <class T>
+vector<T> summa_25d_distributed(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size, view_kernel<T> product)
+{
+    int c = plan_layers(m, n, p, size, rank_memory(), sizeof(T));
+    int q = size / c, layer = rank / q, layer_rank = rank % q;
+    MPI_Comm layer_comm, fiber_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, layer, rank, &layer_comm);
+    MPI_Comm_split(MPI_COMM_WORLD, layer_rank, layer, &fiber_comm);
+
+    auto [k0, k1] = block_range(n, c, layer);
+    int kw = k1 - k0;
+    ProcGrid grid = plan_grid(m, p, q, layer_comm);
+    DistMatrix<T> A_local, B_local;
+    {
+        TRACE_SCOPE(TRACE_COMM, "replicate");
+        vector<MPI_Request> sends;
+        if (rank == 0)
+        {
+            for (int l = 1; l < c; l++)
+            {
+                auto [s0, s1] = block_range(n, c, l);
+                MPI_Datatype a_type = block_type<T>(m, s1 - s0, n), b_type = block_type<T>(s1 - s0, p, p);
+                sends.resize(sends.size() + 2);
+                MPI_Isend(A.data() + s0, 1, a_type, l * q, TAG_LAYER_A, MPI_COMM_WORLD, &sends.end()[-2]);
+                MPI_Isend(B.data() + (long)s0 * p, 1, b_type, l * q, TAG_LAYER_B, MPI_COMM_WORLD, &sends.back());
+                MPI_Type_free(&a_type);
+                MPI_Type_free(&b_type);
+            }
+        }
+
+        vector<T> A_slice, B_slice;
+        ConstMatrixView<T> A_v{nullptr, m, kw, kw}, B_v{nullptr, kw, p, p};
+        if (rank == 0)
+        {
+            A_v = {A.data() + k0, m, kw, n};
+            B_v = {B.data() + (long)k0 * p, kw, p, p};
+        }
+        else if (layer_rank == 0)
+        {
+            A_slice.resize((long)m * kw);
+            B_slice.resize((long)kw * p);
+            MPI_Recv(A_slice.data(), m * kw, mpi_type<T>(), 0, TAG_LAYER_A, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Recv(B_slice.data(), kw * p, mpi_type<T>(), 0, TAG_LAYER_B, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            A_v = {A_slice.data(), m, kw, kw};
+            B_v = {B_slice.data(), kw, p, p};
+        }
+        A_local = scatter_matrix(A_v, {m, kw, grid}, 0, layer_rank);
+        B_local = scatter_matrix(B_v, {kw, p, grid}, 0, layer_rank);
+        MPI_Waitall(sends.size(), sends.data(), MPI_STATUSES_IGNORE);
+    }
+
+    // every layer has the same grid, so rank i of each holds the same block of C
+    DistMatrix<T> C_local = multiply_distributed(A_local, B_local, product);
+    {
+        TRACE_SCOPE(TRACE_COMM, "reduce_layers");
+        int count = C_local.local.size();
+        if (layer == 0)
+            MPI_Reduce(MPI_IN_PLACE, C_local.local.data(), count, mpi_type<T>(), MPI_SUM, 0, fiber_comm);
+        else
+            MPI_Reduce(C_local.local.data(), nullptr, count, mpi_type<T>(), MPI_SUM, 0, fiber_comm);
+    }
+
+    vector<T> C;
+    if (layer == 0)
+        C = gather_matrix(C_local, 0);
+    MPI_Comm_free(&layer_comm);
+    MPI_Comm_free(&fiber_comm);
+    return C;
+}
+
+template <class T>
+vector<T> multiply_summa_25d(const vector<T> &A, const vector<T> &B, int m, int n, int p, int rank, int size)
+{
+    return summa_25d_distributed(A, B, m, n, p, rank, size, multiply_add<T>);
+}
+
+#define INSTANTIATE(T)                                                                                                      \
+    template vector<T> summa_25d_distributed(const vector<T> &, const vector<T> &, int, int, int, int, int, view_kernel<T>); \
+    template vector<T> multiply_summa_25d(const vector<T> &, const vector<T> &, int, int, int, int, int);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -0,0 +1,198 @@
+#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct TraceEvent
+{
+    TracePhase phase;
+    const char *name;
+    int64_t start, duration, flops; // ns since trace_start, flops as reported
+    uint64_t counters[3];
+};
+
+// Spans of one thread, appended under a lock of its own that only trace_start
+// and the export contend for; the buffers outlive their threads so nothing is
+// lost when an OpenMP team shrinks
+struct TraceBuffer
+{
+    int thread;
+    int counter_fd = -1; // perf event group leader, -1 without counters
+    int counters = 0;    // events in the group
+    mutex events_mutex;
+    vector<TraceEvent> events;
+};
+
+static const char *const phase_names[TRACE_PHASES] = {"pack", "compute", "add", "comm", "combine", "kernel"};
+static const char *const counter_names[3] = {"cycles", "cache_misses", "raw"};
+
+static atomic<bool> recording{false};
+static atomic<int64_t> epoch{0};
+static int process_id = 0;
+static mutex buffers_mutex;
+static vector<unique_ptr<TraceBuffer>> buffers;
+
+const char *trace_phase_name(TracePhase phase)
+{
+    return phase_names[phase];
+}
+
+static int64_t now_ns()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef MATMUL_TRACE
+
+static bool counters_enabled = getenv("MATMUL_TRACE_COUNTERS") && atoi(getenv("MATMUL_TRACE_COUNTERS"));
+
+static int open_counter(uint32_t type, uint64_t config, int group)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// Cycles, cache misses and MATMUL_TRACE_RAW_EVENT (a raw PMU code such as a
+// retired floating-point instruction event, which has no generic name) as
+// one group counting the calling thread; left closed when perf events are
+// not available (perf_event_paranoid, containers)
+static void open_counters(TraceBuffer &buffer)
+{
+    int leader = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (leader < 0)
+    {
+        static once_flag warned;
+        call_once(warned, []
+                  { fprintf(stderr, "trace: perf events unavailable, recording without counters\n"); });
+        return;
+    }
+    buffer.counter_fd = leader;
+    buffer.counters = 1 + (open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader) >= 0);
+    const char *raw = getenv("MATMUL_TRACE_RAW_EVENT");
+    if (buffer.counters == 2 && raw && open_counter(PERF_TYPE_RAW, strtoull(raw, nullptr, 0), leader) >= 0)
+        buffer.counters = 3;
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static TraceBuffer &thread_buffer()
+{
+    thread_local TraceBuffer *buffer = nullptr;
+    if (!buffer)
+    {
+        lock_guard<mutex> lock(buffers_mutex);
+        buffers.push_back(make_unique<TraceBuffer>());
+        buffer = buffers.back().get();
+        buffer->thread = buffers.size() - 1;
+        if (counters_enabled)
+            open_counters(*buffer);
+    }
+    return *buffer;
+}
+
+// Group read: the number of counters, then their values in opening order
+static void read_counters(int fd, uint64_t counters[3])
+{
+    uint64_t values[4] = {0, 0, 0, 0};
+    if (fd < 0 || read(fd, values, sizeof(values)) <= 0)
+        values[0] = 0;
+    for (int i = 0; i < 3; i++)
+        counters[i] = i < (int)values[0] ? values[i + 1] : 0;
+}
+
+TraceScope::TraceScope(TracePhase phase, const char *name, int64_t flops)
+    : phase(phase), name(name), flops(flops), active(recording.load(memory_order_relaxed))
+{
+    if (!active)
+        return;
+    read_counters(thread_buffer().counter_fd, counters);
+    start = now_ns();
+}
+
+// A span still open when recording stops, or when trace_start restarts the
+// clock, is dropped
+TraceScope::~TraceScope()
+{
+    if (!active || !recording.load(memory_order_relaxed))
+        return;
+    int64_t end = now_ns();
+    TraceBuffer &buffer = thread_buffer();
+    uint64_t stop[3];
+    read_counters(buffer.counter_fd, stop);
+    int64_t t0 = epoch.load(memory_order_relaxed);
+    if (start < t0)
+        return;
+    lock_guard<mutex> lock(buffer.events_mutex);
+    buffer.events.push_back({phase, name, start - t0, end - start, flops, {stop[0] - counters[0], stop[1] - counters[1], stop[2] - counters[2]}});
+}
+
+#endif
+
+void trace_start(int process)
+{
+    lock_guard<mutex> lock(buffers_mutex);
+    for (auto &buffer : buffers)
+    {
+        lock_guard<mutex> events_lock(buffer->events_mutex);
+        buffer->events.clear();
+    }
+    process_id = process;
+    epoch = now_ns();
+    recording = true;
+}
+
+string trace_events()
+{
+    recording = false;
+    lock_guard<mutex> lock(buffers_mutex);
+    ostringstream out;
+    out << fixed << setprecision(3); // Chrome trace times are in microseconds
+    out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << process_id << ", \"args\": {\"name\": \"rank " << process_id << "\"}}";
+    for (auto &buffer : buffers)
+    {
+        lock_guard<mutex> events_lock(buffer->events_mutex);
+        for (const TraceEvent &e : buffer->events)
+        {
+            out << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"" << phase_names[e.phase] << "\", \"ph\": \"X\", \"pid\": " << process_id
+                << ", \"tid\": " << buffer->thread << ", \"ts\": " << e.start / 1e3 << ", \"dur\": " << e.duration / 1e3 << ", \"args\": {";
+            bool first = true;
+            if (e.flops)
+            {
+                out << "\"flops\": " << e.flops;
+                first = false;
+            }
+            for (int i = 0; i < buffer->counters; i++)
+            {
+                out << (first ? "" : ", ") << "\"" << counter_names[i] << "\": " << e.counters[i];
+                first = false;
+            }
+            out << "}}";
+        }
+    }
+    return out.str();
+}
+
+void trace_write(const string &path)
+{
+    ofstream out(path);
+    out << "{\"traceEvents\": [\n" << trace_events() << "\n]}\n";
+}
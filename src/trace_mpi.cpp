@@ -0,0 +1,34 @@
+#include "distribution.h"
+#include "trace.h"
+#include <fstream>
+
+void trace_start_distributed(MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Barrier(comm);
+    trace_start(rank);
+}
+
+void trace_write_distributed(const string &path, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    string events = trace_events();
+    int length = events.size();
+    vector<int> lengths(size), offsets(size + 1, 0);
+    MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, comm);
+    for (int r = 0; r < size; r++)
+        offsets[r + 1] = offsets[r] + lengths[r];
+
+    string all(rank == 0 ? offsets[size] : 0, ' ');
+    MPI_Gatherv(events.data(), length, MPI_CHAR, all.data(), lengths.data(), offsets.data(), MPI_CHAR, 0, comm);
+    if (rank != 0)
+        return;
+    ofstream out(path);
+    out << "{\"traceEvents\": [\n";
+    for (int r = 0; r < size; r++)
+        out << (r ? ",\n" : "") << string_view(all).substr(offsets[r], lengths[r]);
+    out << "\n]}\n";
+}
@@ -0,0 +1,225 @@
+#include "gemm.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+static long parse_cache_size(const string &s)
+{
+    long v = atol(s.c_str());
+    if (s.find('K') != string::npos)
+        v <<= 10;
+    else if (s.find('M') != string::npos)
+        v <<= 20;
+    return v;
+}
+
+CacheInfo detect_caches()
+{
+    CacheInfo info{0, 0, 0};
+    for (int idx = 0;; ++idx)
+    {
+        string dir = "/sys/devices/system/cpu/cpu0/cache/index" + to_string(idx) + "/";
+        ifstream level_f(dir + "level"), type_f(dir + "type"), size_f(dir + "size");
+        if (!level_f || !type_f || !size_f)
+            break;
+        int level;
+        string type, size;
+        level_f >> level;
+        type_f >> type;
+        size_f >> size;
+        if (type == "Instruction")
+            continue;
+        long bytes = parse_cache_size(size);
+        if (level == 1)
+            info.l1 = bytes;
+        else if (level == 2)
+            info.l2 = bytes;
+        else if (level == 3)
+            info.l3 = bytes;
+    }
+
+    // glibc answers these from cpuid when sysfs is not available
+    if (info.l1 <= 0)
+        info.l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (info.l2 <= 0)
+        info.l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (info.l3 <= 0)
+        info.l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+
+    if (info.l1 <= 0)
+        info.l1 = 32 << 10;
+    if (info.l2 <= 0)
+        info.l2 = 256 << 10;
+    if (info.l3 <= 0)
+        info.l3 = 8 << 20;
+    return info;
+}
+
+static int round_down(int x, int multiple)
+{
+    return max(multiple, x / multiple * multiple);
+}
+
+// Analytic model: a kc x NR micro-panel of B fills half of L1, the mc x kc
+// block of A a quarter of L2 (leaving room for the streamed B and C tiles)
+// and the kc x nc panel of B half of L3. nc is rounded to the float tile,
+// the widest, so no element type pads a panel past nc.
+Blocking default_blocking(const CacheInfo &caches)
+{
+    Blocking b;
+    b.kc = round_down(caches.l1 / 2 / (NR * sizeof(double)), 8);
+    b.mc = round_down(caches.l2 / 4 / (b.kc * sizeof(double)), MR);
+    b.nc = round_down(min<long>(caches.l3 / 2 / (b.kc * sizeof(double)), 8192), nr_v<float>);
+    return b;
+}
+
+static string tuning_file()
+{
+    const char *path = getenv("MATMUL_TUNING_FILE");
+    return path ? path : "matmul_tuning.txt";
+}
+
+static map<string, int> load_tuning()
+{
+    map<string, int> values;
+    ifstream in(tuning_file());
+    string line;
+    while (getline(in, line))
+    {
+        istringstream ss(line);
+        string key;
+        int value;
+        if (line.empty() || line[0] == '#' || !(ss >> key >> value) || value <= 0)
+            continue;
+        values[key] = value;
+    }
+    return values;
+}
+
+// Merges into the existing file. Written to a private file and renamed so
+// concurrent ranks never read a torn file.
+static void save_tuning(const map<string, int> &updates)
+{
+    map<string, int> values = load_tuning();
+    for (auto &[key, value] : updates)
+        values[key] = value;
+
+    string path = tuning_file();
+    string tmp = path + "." + to_string(getpid());
+    {
+        ofstream out(tmp);
+        out << "# generated by MATMUL_AUTOTUNE=1\n";
+        for (auto &[key, value] : values)
+            out << key << " " << value << "\n";
+    }
+    rename(tmp.c_str(), path.c_str());
+}
+
+static bool autotune_enabled()
+{
+    const char *tune = getenv("MATMUL_AUTOTUNE");
+    return tune && atoi(tune);
+}
+
+static double time_best(const function<void()> &run)
+{
+    double best = 1e30;
+    for (int rep = 0; rep < 2; ++rep)
+    {
+        auto t0 = chrono::high_resolution_clock::now();
+        run();
+        auto t1 = chrono::high_resolution_clock::now();
+        best = min(best, chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+static double time_gemm(const Blocking &b, const vector<double> &A, const vector<double> &B, vector<double> &C, int size)
+{
+    return time_best([&] { gemm(A.data(), size, B.data(), size, C.data(), size, size, size, size, b); });
+}
+
+// Coordinate search around the analytic blocking: kc first since it sets the
+// L1 footprint, then mc. nc only matters for panels larger than L3 and keeps
+// its analytic value.
+Blocking autotune_blocking()
+{
+    const int size = 768;
+    vector<double> A(size * size, 1.0), B(size * size, 1.0), C(size * size);
+
+    Blocking best = default_blocking(detect_caches());
+    double best_t = time_gemm(best, A, B, C, size);
+
+    const double scales[] = {0.5, 0.75, 1.5, 2.0};
+    for (int dim = 0; dim < 2; ++dim)
+    {
+        Blocking base = best;
+        for (double s : scales)
+        {
+            Blocking cand = base;
+            if (dim == 0)
+                cand.kc = round_down(base.kc * s, 8);
+            else
+                cand.mc = round_down(base.mc * s, MR);
+            double t = time_gemm(cand, A, B, C, size);
+            if (t < best_t)
+            {
+                best_t = t;
+                best = cand;
+            }
+        }
+    }
+
+    save_tuning({{"mc", best.mc}, {"kc", best.kc}, {"nc", best.nc}});
+    return best;
+}
+
+static Blocking init_blocking()
+{
+    Blocking b = default_blocking(detect_caches());
+    map<string, int> values = load_tuning();
+    if (values.count("mc") && values.count("kc") && values.count("nc"))
+    {
+        b.mc = round_down(values["mc"], MR);
+        b.kc = values["kc"];
+        b.nc = round_down(values["nc"], nr_v<float>);
+        return b;
+    }
+    if (autotune_enabled())
+        return autotune_blocking();
+    return b;
+}
+
+const Blocking &blocking()
+{
+    static const Blocking b = init_blocking();
+    return b;
+}
+
+int tuned_cutoff(const string &key, int fallback, const square_kernel &leaf, const square_kernel &step)
+{
+    map<string, int> values = load_tuning();
+    if (values.count(key))
+        return values[key];
+    if (!autotune_enabled())
+        return fallback;
+
+    int cutoff = 2048;
+    for (int size = 256; size <= 2048; size *= 2)
+    {
+        vector<double> A(size * size, 1.0), B(size * size, 1.0);
+        double t_leaf = time_best([&] { leaf(A, B, size); });
+        double t_step = time_best([&] { step(A, B, size); });
+        if (t_step < t_leaf)
+        {
+            cutoff = size / 2;
+            break;
+        }
+    }
+    save_tuning({{key, cutoff}});
+    return cutoff;
+}
@@ -1,43 +1,98 @@
 #include "matrix.h"
+#include "trace.h"
 
-vector<double> add(const vector<double> &A, const vector<double> &B, int size)
+template <class T>
+vector<T> add(const vector<T> &A, const vector<T> &B, int size)
+{
+    vector<T> C(size * size);
+    add<T>({A.data(), size, size, size}, {B.data(), size, size, size}, {C.data(), size, size, size});
+    return C;
+}
+
+template <class T>
+vector<T> sub(const vector<T> &A, const vector<T> &B, int size)
+{
+    vector<T> C(size * size);
+    sub<T>({A.data(), size, size, size}, {B.data(), size, size, size}, {C.data(), size, size, size});
+    return C;
+}
+
+// c = op(a, b) over one row, in SIMD chunks for the real types
+template <class T, class Op>
+static void combine_row(const T *a, const T *b, T *c, int cols, Op op)
 {
-    vector<double> C(size * size);
-    using simd_type = simd<double>;
-    constexpr int simd_size = simd_type::size();
     int i = 0;
-    for (; i + simd_size - 1 < size * size; i += simd_size)
+    if constexpr (!is_complex_v<T>)
     {
-        simd_type aVec(&A[i], element_aligned);
-        simd_type bVec(&B[i], element_aligned);
-        simd_type cVec = aVec + bVec;
-        cVec.copy_to(&C[i], element_aligned);
+        using simd_type = simd<T>;
+        constexpr int simd_size = simd_type::size();
+        for (; i + simd_size - 1 < cols; i += simd_size)
+        {
+            simd_type aVec(&a[i], element_aligned);
+            simd_type bVec(&b[i], element_aligned);
+            simd_type cVec = op(aVec, bVec);
+            cVec.copy_to(&c[i], element_aligned);
+        }
     }
-    for (; i < size * size; ++i)
+    for (; i < cols; ++i)
     {
-        C[i] = A[i] + B[i];
+        c[i] = op(a[i], b[i]);
     }
-    return C;
 }
 
-vector<double> sub(const vector<double> &A, const vector<double> &B, int size)
+template <class T>
+void add(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
 {
-    vector<double> C(size * size);
-    using simd_type = simd<double>;
-    constexpr int simd_size = simd_type::size();
-    int i = 0;
-    for (; i + simd_size - 1 < size * size; i += simd_size)
+    TRACE_SCOPE(TRACE_ADD, "add");
+    for (int r = 0; r < C.rows; ++r)
+        combine_row(&A.data[(long)r * A.ld], &B.data[(long)r * B.ld], &C.data[(long)r * C.ld], C.cols, [](auto x, auto y) { return x + y; });
+}
+
+template <class T>
+void sub(const_view_t<T> A, const_view_t<T> B, MatrixView<T> C)
+{
+    TRACE_SCOPE(TRACE_ADD, "sub");
+    for (int r = 0; r < C.rows; ++r)
+        combine_row(&A.data[(long)r * A.ld], &B.data[(long)r * B.ld], &C.data[(long)r * C.ld], C.cols, [](auto x, auto y) { return x - y; });
+}
+
+template <class T>
+void copy_view(const_view_t<T> A, MatrixView<T> C)
+{
+    for (int r = 0; r < C.rows; ++r)
+        copy(&A.data[(long)r * A.ld], &A.data[(long)r * A.ld + C.cols], &C.data[(long)r * C.ld]);
+}
+
+template <class T>
+void zero_view(MatrixView<T> C)
+{
+    for (int r = 0; r < C.rows; ++r)
+        fill(&C.data[(long)r * C.ld], &C.data[(long)r * C.ld + C.cols], T(0));
+}
+
+template <class T>
+void scale_view(MatrixView<T> C, type_identity_t<T> beta)
+{
+    if (beta == T(0))
     {
-        simd_type aVec(&A[i], element_aligned);
-        simd_type bVec(&B[i], element_aligned);
-        simd_type cVec = aVec - bVec;
-        cVec.copy_to(&C[i], element_aligned);
+        zero_view(C);
+        return;
     }
-    for (; i < size * size; ++i)
+    if (beta == T(1))
+        return;
+    for (int r = 0; r < C.rows; ++r)
     {
-        C[i] = A[i] - B[i];
+        T *row = &C.data[(long)r * C.ld];
+        combine_row(row, row, row, C.cols, [beta](auto x, auto) { return x * beta; });
     }
-    return C;
+}
+
+long strassen_workspace(int m, int n, int p, int cutoff)
+{
+    if (min(m, min(n, p)) <= cutoff)
+        return 0;
+    long hm = m / 2, hn = n / 2, hp = p / 2;
+    return hm * hn + hn * hp + hm * hp + strassen_workspace(hm, hn, hp, cutoff);
 }
 
 int next_pow2(int x)
@@ -47,3 +102,13 @@ int next_pow2(int x)
         p <<= 1;
     return p;
 }
+
+#define INSTANTIATE(T)                                                      \
+    template vector<T> add(const vector<T> &, const vector<T> &, int);      \
+    template vector<T> sub(const vector<T> &, const vector<T> &, int);      \
+    template void add<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>); \
+    template void sub<T>(const_view_t<T>, const_view_t<T>, MatrixView<T>); \
+    template void copy_view<T>(const_view_t<T>, MatrixView<T>);            \
+    template void zero_view(MatrixView<T>);                                 \
+    template void scale_view(MatrixView<T>, type_identity_t<T>);
+MATMUL_FOR_EACH_TYPE(INSTANTIATE)
@@ -0,0 +1,37 @@
+#include "workspace.h"
+#include <sys/mman.h>
+
+static bool hugepages = getenv("MATMUL_HUGEPAGES") && atoi(getenv("MATMUL_HUGEPAGES"));
+static const size_t huge_page_size = 2 << 20;
+
+aligned_buffer aligned_array(size_t bytes)
+{
+    bytes = max<size_t>(bytes, 1);
+    size_t align = hugepages && bytes >= huge_page_size ? huge_page_size : WORKSPACE_ALIGN;
+    bytes = (bytes + align - 1) / align * align;
+    void *p = aligned_alloc(align, bytes);
+    if (!p)
+        throw bad_alloc();
+    if (align == huge_page_size)
+        madvise(p, bytes, MADV_HUGEPAGE);
+    return aligned_buffer(static_cast<byte *>(p));
+}
+
+struct Arena
+{
+    aligned_buffer buffer[WS_SLOTS];
+    size_t capacity[WS_SLOTS] = {};
+};
+
+void *workspace_bytes(WorkspaceSlot slot, size_t bytes)
+{
+    static thread_local Arena arena;
+    if (bytes > arena.capacity[slot])
+    {
+        // grow geometrically so slowly increasing shapes do not reallocate every call
+        size_t capacity = max(bytes, arena.capacity[slot] + arena.capacity[slot] / 2);
+        arena.buffer[slot] = aligned_array(capacity);
+        arena.capacity[slot] = capacity;
+    }
+    return arena.buffer[slot].get();
+}
@@ -33,6 +33,94 @@ void test_hybrid(int N, int rank, int size)
     }
 }
 
+void test_summa_hybrid(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    vector<double> A;
+    vector<double> B;
+    if (rank == 0)
+    {
+        A.assign(m * n, 1);
+        B.assign(n * p, 1);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_summa_hybrid(A, B, m, n, p, rank, size);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        assert(C == libcheck(A, B, m, n, p));
+    }
+}
+
+void test_summa_25d_hybrid(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    vector<double> A;
+    vector<double> B;
+    if (rank == 0)
+    {
+        A.assign(m * n, 1);
+        B.assign(n * p, 1);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_summa_25d_hybrid(A, B, m, n, p, rank, size);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        assert(C == libcheck(A, B, m, n, p));
+    }
+}
+
+void test_hybrid_pipelined(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    vector<double> A;
+    vector<double> B;
+    if (rank == 0)
+    {
+        A.assign(m * n, 1);
+        B.assign(n * p, 1);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_hybrid_pipelined(A, B, m, n, p, rank, size);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        assert(C == libcheck(A, B, m, n, p));
+    }
+}
+
+void test_hybrid_shared(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    vector<double> A;
+    vector<double> B;
+    if (rank == 0)
+    {
+        A.assign(m * n, 1);
+        B.assign(n * p, 1);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_hybrid_shared(A, B, m, n, p, rank, size);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        assert(C == libcheck(A, B, m, n, p));
+    }
+}
+
 int main(int argc, char *argv[])
 {
     int rank, size;
@@ -45,6 +133,10 @@ int main(int argc, char *argv[])
         N = atoi(argv[1]);
     }
     test_hybrid(N, rank, size);
+    test_summa_hybrid(N, rank, size);
+    test_summa_25d_hybrid(N, rank, size);
+    test_hybrid_pipelined(N, rank, size);
+    test_hybrid_shared(N, rank, size);
     MPI_Finalize();
     return 0;
 }
@@ -1,5 +1,9 @@
 #include "matrix.h"
+#include "distribution.h"
 #include "test_cases.h"
+#include "matrix_file.h"
+#include <filesystem>
+#include <unistd.h>
 #include <mpi.h>
 #include <cassert>
 
@@ -33,6 +37,188 @@ void test_mpi(int N, int rank, int size)
     }
 }
 
+void test_summa(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    vector<double> A;
+    vector<double> B;
+    if (rank == 0)
+    {
+        A.assign(m * n, 1);
+        B.assign(n * p, 1);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_summa(A, B, m, n, p, rank, size);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        assert(C == libcheck(A, B, m, n, p));
+    }
+}
+
+void test_summa_25d(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    vector<double> A;
+    vector<double> B;
+    if (rank == 0)
+    {
+        A.assign(m * n, 1);
+        B.assign(n * p, 1);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_summa_25d(A, B, m, n, p, rank, size);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        assert(C == libcheck(A, B, m, n, p));
+    }
+
+    // 8 ranks take 2 layers given the memory, and 1 when a layer leader
+    // could hold its blocks but not the K slices it receives as well
+    double blocks = (2.0 * N * N + 2.0 * N * N) / 8 * sizeof(double);
+    assert(N < 2 || plan_layers(N, N, N, 8, 1e300, sizeof(double)) == 2);
+    assert(plan_layers(N, N, N, 8, blocks, sizeof(double)) == 1);
+}
+
+void test_mpi_pipelined(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    vector<double> A;
+    vector<double> B;
+    if (rank == 0)
+    {
+        A.assign(m * n, 1);
+        B.assign(n * p, 1);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_mpi_pipelined(A, B, m, n, p, rank, size);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        assert(C == libcheck(A, B, m, n, p));
+    }
+}
+
+// N products of 32 x 32 matrices, spread whole over the ranks
+void test_batched_mpi(int N, int rank, int size)
+{
+    int count = N, m = 32, n = 32, p = 32;
+    vector<double> A;
+    vector<double> B;
+    if (rank == 0)
+    {
+        A.assign((long)count * m * n, 1);
+        B.assign((long)count * n * p, 1);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_batched_mpi(A, B, m, n, p, count, rank, size);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        vector<double> expected = libcheck(vector<double>(m * n, 1), vector<double>(n * p, 1), m, n, p);
+        for (int i = 0; i < count; i++)
+            assert(vector<double>(C.begin() + (long)i * m * p, C.begin() + (long)(i + 1) * m * p) == expected);
+    }
+}
+
+// Every rank fills its own blocks, only C is gathered for the check
+void test_distributed(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    ProcGrid grid = plan_grid(m, p, size);
+    DistMatrix<double> A = make_distributed<double>({m, n, grid}, rank);
+    DistMatrix<double> B = make_distributed<double>({n, p, grid}, rank);
+    fill(A.local.begin(), A.local.end(), 1);
+    fill(B.local.begin(), B.local.end(), 1);
+
+    auto t0 = chrono::high_resolution_clock::now();
+    DistMatrix<double> C = multiply_distributed(A, B);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    vector<double> C_full = gather_matrix(C, 0);
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        assert(C_full == libcheck(vector<double>(m * n, 1), vector<double>(n * p, 1), m, n, p));
+    }
+}
+
+// Uneven row partitions scattered and gathered over two halves of the
+// ranks, each half its own communicator
+void test_rows_split(int N, int rank, int /*size*/)
+{
+    MPI_Comm half;
+    MPI_Comm_split(MPI_COMM_WORLD, rank % 2, rank, &half);
+    int half_rank;
+    MPI_Comm_rank(half, &half_rank);
+    int m = N + 3, cols = 7;
+    vector<double> M;
+    if (half_rank == 0)
+        M = random_matrix(m, cols, rank % 2);
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<int> rows = weighted_rows(m, half_rank + 1, half);
+    vector<double> local = scatter_rows(M, rows, cols, 0, half_rank, half);
+    vector<double> back = gather_rows(local, rows, cols, 0, half_rank, half);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    assert((int)local.size() == (rows[half_rank + 1] - rows[half_rank]) * cols);
+    if (half_rank == 0)
+        assert(back == M);
+    if (rank == 0)
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+    MPI_Comm_free(&half);
+}
+
+// A (ROW_MAJOR) and B (COL_MAJOR) written by rank 0; every rank reads just
+// its SUMMA blocks with MPI-IO and writes its block of C back the same way
+void test_file_distributed(int N, int rank, int size)
+{
+    int m = N, n = N, p = N;
+    int id = getpid();
+    MPI_Bcast(&id, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    string dir = filesystem::temp_directory_path().string() + "/matmul_io_" + to_string(id);
+    vector<double> A(m * n, 1);
+    vector<double> B(n * p, 1);
+    if (rank == 0)
+    {
+        filesystem::create_directory(dir);
+        write_matrix_file<double>(dir + "/A", {A.data(), m, n, n});
+        write_matrix_file<double>(dir + "/B", {B.data(), n, p, p}, COL_MAJOR);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    auto t0 = chrono::high_resolution_clock::now();
+    ProcGrid grid = plan_grid(m, p, size);
+    DistMatrix<double> A_local = read_matrix_distributed<double>(dir + "/A", grid, rank);
+    DistMatrix<double> B_local = read_matrix_distributed<double>(dir + "/B", grid, rank);
+    write_matrix_distributed(dir + "/C", multiply_distributed(A_local, B_local));
+    auto t1 = chrono::high_resolution_clock::now();
+
+    if (rank == 0)
+    {
+        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+        int rows, cols;
+        vector<double> C = read_matrix_file<double>(dir + "/C", rows, cols);
+        filesystem::remove_all(dir);
+        assert(rows == m && cols == p);
+        assert(C == libcheck(A, B, m, n, p));
+    }
+}
+
 int main(int argc, char *argv[])
 {
     int rank, size;
@@ -45,6 +231,13 @@ int main(int argc, char *argv[])
         N = atoi(argv[1]);
     }
     test_mpi(N, rank, size);
+    test_summa(N, rank, size);
+    test_summa_25d(N, rank, size);
+    test_mpi_pipelined(N, rank, size);
+    test_distributed(N, rank, size);
+    test_rows_split(N, rank, size);
+    test_batched_mpi(N, rank, size);
+    test_file_distributed(N, rank, size);
     MPI_Finalize();
     return 0;
 }
@@ -1,6 +1,12 @@
 #include "matrix.h"
 #include "test_cases.h"
+#include "gemm.h"
+#include "matrix_file.h"
+#include <filesystem>
+#include <unistd.h>
 #include <cassert>
+#include <omp.h>
+#include <thread>
 
 void test_omp(int N)
 {
@@ -24,26 +30,127 @@ void test_omp(int N)
     assert(C == libcheck(A, B, m, n, p));
 }
 
-void test_strassen_omp(int N)
+// Random operands on non-square shapes: row blocks, a 2D grid and a tall
+// inner dimension that splits K over the threads. Run under
+// OMP_THREAD_LIMIT as well, where the team is smaller than planned for.
+void test_omp_shapes(int N)
 {
-    int m = N, n = N, p = N;
-    vector<double> A(m * n);
-    vector<double> B(n * p);
-
-    for (int i = 0; i < m * n; i++)
+    vector<array<int, 3>> shapes = {{N + 7, N / 2 + 3, max(1, N - 5)}, {64, 4 * N, 64}, {16, 2 * N, 4 * N}, {3, N, 5}};
+    auto t0 = chrono::high_resolution_clock::now();
+    for (auto [m, n, p] : shapes)
     {
-        A[i] = 1;
-    }
+        vector<double> A = random_matrix(m, n, 1), B = random_matrix(n, p, 2);
+        vector<double> expected = libcheck(A, B, m, n, p);
+        assert(max_error(multiply_omp(A, B, m, n, p), expected) < 1e-12 * n);
 
-    for (int i = 0; i < n * p; i++)
-    {
-        B[i] = 1;
+        vector<double> C(m * p, 5);
+        multiply_omp<double>({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p});
+        assert(max_error(C, expected) < 1e-12 * n);
     }
+    auto t1 = chrono::high_resolution_clock::now();
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+}
+
+// multiply_omp called from inside a parallel region gets a team of one
+void test_omp_nested(int N)
+{
+    int m = N + 1, n = 2 * N, p = N / 2 + 1;
+    vector<double> A = random_matrix(m, n, 3), B = random_matrix(n, p, 4);
+    vector<double> C;
+    auto t0 = chrono::high_resolution_clock::now();
+    #pragma omp parallel num_threads(2)
+    #pragma omp single
+    C = multiply_omp(A, B, m, n, p);
+    auto t1 = chrono::high_resolution_clock::now();
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+    assert(max_error(C, libcheck(A, B, m, n, p)) < 1e-12 * n);
+}
+
+// fp32 gemm_omp with a panel width nc of one double tile, half a float one,
+// on a B narrower than a float tile and many row blocks of A, so the threads
+// take row blocks and share padded B panels. Run from a new thread, whose
+// team's packing workspaces are sized by this call alone.
+void test_omp_float_panels(int N)
+{
+    Blocking b{MR, 64, NR};
+    int m = 64 * MR + 1, n = N, p = NR + 5;
+    vector<double> A = random_matrix(m, n, 5), B = random_matrix(n, p, 6);
+    vector<float> A_f(A.begin(), A.end()), B_f(B.begin(), B.end()), C(m * p);
+    auto t0 = chrono::high_resolution_clock::now();
+    thread([&] { gemm_omp(A_f.data(), n, B_f.data(), p, C.data(), p, m, n, p, b); }).join();
+    auto t1 = chrono::high_resolution_clock::now();
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+    vector<double> expected = libcheck(vector<double>(A_f.begin(), A_f.end()), vector<double>(B_f.begin(), B_f.end()), m, n, p);
+    assert(max_error(vector<double>(C.begin(), C.end()), expected) < 1e-6 * n);
+}
+
+// Random operands: the N-sized product at the tuned cutoffs, then an odd,
+// rectangular one with a small cutoff, so the task graph runs with odd rows,
+// columns and inner indices at its levels and serial Strassen below them
+void test_strassen_omp(int N)
+{
+    int m = N, n = N, p = N;
+    vector<double> A = random_matrix(m, n, 1), B = random_matrix(n, p, 2);
     auto t0 = chrono::high_resolution_clock::now();
     vector<double> C = strassen_omp(A, B, m, n, p);
     auto t1 = chrono::high_resolution_clock::now();
     cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+    assert(max_error(C, libcheck(A, B, m, n, p)) < 1e-10 * n);
+
+    m = N / 4 + 1, n = N / 6 + 1, p = N / 5 + 3;
+    A = random_matrix(m, n, 3), B = random_matrix(n, p, 4), C.assign(m * p, 0);
+    strassen_omp<double>({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p}, 16);
+    assert(max_error(C, libcheck(A, B, m, n, p)) < 1e-10 * n);
+}
+
+// Many small products run whole per thread, the N-sized ones are split
+void test_batched_omp(int N)
+{
+    int count = 256, s = 32;
+    vector<double> A(count * s * s, 1);
+    vector<double> B(count * s * s, 1);
+    vector<double> A_big(2 * N * N, 1);
+    vector<double> B_big(2 * N * N, 1);
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = multiply_batched_omp(A, B, s, s, s, count);
+    vector<double> C_big = multiply_batched_omp(A_big, B_big, N, N, N, 2);
+    auto t1 = chrono::high_resolution_clock::now();
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+
+    vector<double> expected = libcheck(vector<double>(s * s, 1), vector<double>(s * s, 1), s, s, s);
+    for (int i = 0; i < count; i++)
+        assert(vector<double>(C.begin() + i * s * s, C.begin() + (i + 1) * s * s) == expected);
+    expected = libcheck(vector<double>(N * N, 1), vector<double>(N * N, 1), N, N, N);
+    assert(vector<double>(C_big.begin(), C_big.begin() + N * N) == expected);
+    assert(vector<double>(C_big.begin() + N * N, C_big.end()) == expected);
+}
+
+// A, B and C as files, with a memory budget of about a quarter of one operand
+// so the product streams through several tiles along every dimension; C is
+// read back with the parallel reader, once as written and once COL_MAJOR
+void test_out_of_core(int N)
+{
+    int m = N, n = N / 2 + 1, p = N + 3;
+    vector<double> A(m * n, 1);
+    vector<double> B(n * p, 1);
+    string dir = filesystem::temp_directory_path().string() + "/matmul_ooc_" + to_string(getpid());
+    filesystem::create_directory(dir);
+    write_matrix_file<double>(dir + "/A", {A.data(), m, n, n});
+    write_matrix_file<double>(dir + "/B", {B.data(), n, p, p});
+
+    auto t0 = chrono::high_resolution_clock::now();
+    multiply_out_of_core<double>(dir + "/A", dir + "/B", dir + "/C", (long)m * n * sizeof(double) / 4);
+    auto t1 = chrono::high_resolution_clock::now();
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+
+    int rows, cols;
+    vector<double> C = read_matrix_file_omp<double>(dir + "/C", rows, cols);
+    assert(rows == m && cols == p);
     assert(C == libcheck(A, B, m, n, p));
+    write_matrix_file<double>(dir + "/C", {C.data(), m, p, p}, COL_MAJOR);
+    assert(read_matrix_file_omp<double>(dir + "/C", rows, cols) == C);
+    filesystem::remove_all(dir);
 }
 
 int main(int argc, char *argv[])
@@ -54,6 +161,11 @@ int main(int argc, char *argv[])
         N = atoi(argv[1]);
     }
     test_omp(N);
+    test_omp_shapes(N);
+    test_omp_nested(N);
+    test_omp_float_panels(N);
     test_strassen_omp(N);
+    test_batched_omp(N);
+    test_out_of_core(N);
     return 0;
 }
@@ -1,5 +1,8 @@
 #include "matrix.h"
 #include "test_cases.h"
+#include "fixed.h"
+#include <array>
+#include <thread>
 
 int main(int argc, char *argv[])
 {
@@ -10,6 +13,11 @@ int main(int argc, char *argv[])
     }
     test_serial(N);
     test_strassen(N);
+    test_dgemm(N);
+    test_float(N);
+    test_float_panels(N);
+    test_batched(N);
+    test_fixed(N);
     return 0;
 }
 
@@ -37,26 +45,152 @@ void test_serial(int N)
     assert(C == libcheck(A, B, m, n, p));
 }
 
+// Random operands: the N-sized product at the tuned cutoff, then an odd,
+// rectangular one with a small cutoff, so the recursion halves unequal
+// dimensions and peels an odd row, column or inner index at several levels
 void test_strassen(int N)
 {
     int m = N, n = N, p = N;
-    vector<double> A(m * n);
-    vector<double> B(n * p);
+    vector<double> A = random_matrix(m, n, 1), B = random_matrix(n, p, 2);
 
-    for (int i = 0; i < m * n; i++)
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<double> C = strassen(A, B, m, n, p);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+    assert(max_error(C, libcheck(A, B, m, n, p)) < 1e-10 * n);
+
+    m = N / 4 + 1, n = N / 6 + 1, p = N / 5 + 1;
+    A = random_matrix(m, n, 3), B = random_matrix(n, p, 4), C.assign(m * p, 0);
+    strassen<double>({A.data(), m, n, n}, {B.data(), n, p, p}, {C.data(), m, p, p}, 16);
+    assert(max_error(C, libcheck(A, B, m, n, p)) < 1e-10 * n);
+}
+
+// Row-major rows x cols matrix stored transposed
+static vector<double> transposed(const vector<double> &M, int rows, int cols)
+{
+    vector<double> T((long)rows * cols);
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < cols; j++)
+            T[(long)j * rows + i] = M[(long)i * cols + j];
+    return T;
+}
+
+// C = 2 * op(A) * op(B) - 0.5 * C on random operands, for every combination
+// of A and B stored as is or transposed
+void test_dgemm(int N)
+{
+    int m = N, n = N / 2 + 1, p = N + 3;
+    vector<double> A = random_matrix(m, n, 1), B = random_matrix(n, p, 2), C0 = random_matrix(m, p, 3);
+    vector<double> expected = libcheck(A, B, m, n, p);
+    for (long i = 0; i < (long)m * p; i++)
+        expected[i] = 2 * expected[i] - 0.5 * C0[i];
+    vector<double> At = transposed(A, m, n), Bt = transposed(B, n, p);
+
+    auto t0 = chrono::high_resolution_clock::now();
+    for (Transpose transA : {NoTrans, Trans})
+        for (Transpose transB : {NoTrans, Trans})
+        {
+            vector<double> C = C0;
+            const vector<double> &A_s = transA == Trans ? At : A, &B_s = transB == Trans ? Bt : B;
+            dgemm(transA, transB, m, n, p, 2.0, A_s.data(), transA == Trans ? m : n, B_s.data(), transB == Trans ? n : p, -0.5, C.data(), p);
+            assert(max_error(C, expected) < 1e-12 * n);
+        }
+    auto t1 = chrono::high_resolution_clock::now();
+
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+}
+
+// fp32 storage, once with fp32 and once with fp64 accumulation, over a long
+// inner dimension of terms of +-1000 that cancel down to the small random
+// part: fp32 sums lose it, fp64 sums keep it until the final rounding
+void test_float(int N)
+{
+    int m = max(8, N / 8), n = 16 * N, p = max(8, N / 8);
+    vector<double> A = random_matrix(m, n, 4), B = random_matrix(n, p, 5);
+    for (int i = 0; i < m; i++)
+        for (int k = 0; k < n; k++)
+            A[(long)i * n + k] += k % 2 ? 1000 : -1000;
+    vector<float> A_f(A.begin(), A.end()), B_f(B.begin(), B.end());
+
+    auto t0 = chrono::high_resolution_clock::now();
+    vector<float> C = multiply(A_f, B_f, m, n, p);
+    auto t1 = chrono::high_resolution_clock::now();
+    vector<float> C_mixed = multiply_mixed(A_f, B_f, m, n, p);
+
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+    vector<double> expected = libcheck(vector<double>(A_f.begin(), A_f.end()), vector<double>(B_f.begin(), B_f.end()), m, n, p);
+    double error = max_error(vector<double>(C.begin(), C.end()), expected);
+    double error_mixed = max_error(vector<double>(C_mixed.begin(), C_mixed.end()), expected);
+    assert(error < 1e-7 * 1000 * n);
+    assert(error_mixed < error);
+    for (long i = 0; i < (long)m * p; i++)
+        assert(abs(C_mixed[i] - expected[i]) <= 0x1p-23 * abs(expected[i]) + 1e-9);
+}
+
+// fp32 gemm with a panel width nc that is a multiple of the double tile but
+// not of the twice as wide float one, so the last float panel is padded past nc.
+// Run on a new thread, whose packing workspace is sized by this call alone.
+void test_float_panels(int N)
+{
+    Blocking b{4 * MR, 64, 3 * nr_v<float> + NR};
+    int m = 64, n = N, p = 2 * b.nc + 5;
+    vector<double> A = random_matrix(m, n, 6), B = random_matrix(n, p, 7);
+    vector<float> A_f(A.begin(), A.end()), B_f(B.begin(), B.end()), C(m * p);
+
+    auto t0 = chrono::high_resolution_clock::now();
+    thread([&] { gemm(A_f.data(), n, B_f.data(), p, C.data(), p, m, n, p, b); }).join();
+    auto t1 = chrono::high_resolution_clock::now();
+
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+    vector<double> expected = libcheck(vector<double>(A_f.begin(), A_f.end()), vector<double>(B_f.begin(), B_f.end()), m, n, p);
+    assert(max_error(vector<double>(C.begin(), C.end()), expected) < 1e-6 * n);
+}
+
+// Variable-size batch: the fixed-size kernels, odd shapes and one N-sized product
+void test_batched(int N)
+{
+    vector<array<int, 3>> shapes = {{4, 4, 4}, {8, 8, 8}, {16, 16, 16}, {32, 32, 32}, {33, 17, 5}, {N, N / 2 + 1, N / 3 + 2}};
+    vector<vector<double>> A, B, C;
+    vector<BatchProduct<double>> batch;
+    for (auto [m, n, p] : shapes)
     {
-        A[i] = 1;
+        A.emplace_back(m * n, 1);
+        B.emplace_back(n * p, 1);
+        C.emplace_back(m * p);
+    }
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        auto [m, n, p] = shapes[i];
+        batch.push_back({{A[i].data(), m, n, n}, {B[i].data(), n, p, p}, {C[i].data(), m, p, p}});
     }
 
-    for (int i = 0; i < n * p; i++)
+    auto t0 = chrono::high_resolution_clock::now();
+    multiply_batched(batch);
+    auto t1 = chrono::high_resolution_clock::now();
+
+    cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+    for (size_t i = 0; i < shapes.size(); i++)
     {
-        B[i] = 1;
+        auto [m, n, p] = shapes[i];
+        assert(C[i] == libcheck(A[i], B[i], m, n, p));
     }
+}
+
+// N products of an odd fixed shape, and multiply() dispatching 32 x 32
+void test_fixed(int N)
+{
+    constexpr int m = 5, n = 7, p = 13, s = 32;
+    vector<double> A(m * n, 1), B(n * p, 1), C(m * p);
+    vector<double> A_s(s * s, 1), B_s(s * s, 1);
 
     auto t0 = chrono::high_resolution_clock::now();
-    vector<double> C = strassen(A, B, m, n, p);
+    for (int i = 0; i < N; i++)
+        multiply_fixed<m, n, p>(ConstMatView{A.data(), m, n, n}, ConstMatView{B.data(), n, p, p}, MatView{C.data(), m, p, p});
     auto t1 = chrono::high_resolution_clock::now();
+    vector<double> C_s = multiply(A_s, B_s, s, s, s);
 
     cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
     assert(C == libcheck(A, B, m, n, p));
-}
\ No newline at end of file
+    assert(C_s == libcheck(A_s, B_s, s, s, s));
+}
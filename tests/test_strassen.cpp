@@ -2,28 +2,21 @@
 #include "test_cases.h"
 #include <mpi.h>
 #include <cassert>
+#include <array>
 
 /*
-    test distribute strassen, due to it nature of needing exactly 7 proc
+    test distribute strassen, any process count: 7 and more ranks split into
+    Strassen groups, fewer fall back to SUMMA
 */
 
 void test_strassen_hybrid(int N, int rank, int size)
 {
     int m = N, n = N, p = N;
-    vector<double> A;
-    vector<double> B;
+    vector<double> A, B;
     if (rank == 0)
     {
-        A.resize(m * n);
-        for (int i = 0; i < m * n; i++)
-        {
-            A[i] = 1;
-        }
-        B.resize(n * p);
-        for (int i = 0; i < n * p; i++)
-        {
-            B[i] = 1;
-        }
+        A = random_matrix(m, n, 1);
+        B = random_matrix(n, p, 2);
     }
 
     auto t0 = chrono::high_resolution_clock::now();
@@ -33,37 +26,33 @@ void test_strassen_hybrid(int N, int rank, int size)
     if (rank == 0)
     {
         cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
-        assert(C == libcheck(A, B, m, n, p));
+        assert(max_error(C, libcheck(A, B, m, n, p)) < 1e-10 * n);
     }
 }
 
+// Random operands, once N-sized and once with every dimension odd: rank 0
+// peels the odd row, column and inner index around the quadrants the groups
+// return, and the groups multiply odd-sized quadrants
 void test_strassen_mpi(int N, int rank, int size)
 {
-    int m = N, n = N, p = N;
-    vector<double> A;
-    vector<double> B;
-    if (rank == 0)
+    for (auto [m, n, p] : {array<int, 3>{N, N, N}, array<int, 3>{N | 1, N / 2 | 1, N / 3 | 1}})
     {
-        A.resize(m * n);
-        for (int i = 0; i < m * n; i++)
-        {
-            A[i] = 1;
-        }
-        B.resize(n * p);
-        for (int i = 0; i < n * p; i++)
+        vector<double> A, B;
+        if (rank == 0)
         {
-            B[i] = 1;
+            A = random_matrix(m, n, 3);
+            B = random_matrix(n, p, 4);
         }
-    }
 
-    auto t0 = chrono::high_resolution_clock::now();
-    vector<double> C = strassen_mpi(A, B, m, n, p, rank, size);
-    auto t1 = chrono::high_resolution_clock::now();
+        auto t0 = chrono::high_resolution_clock::now();
+        vector<double> C = strassen_mpi(A, B, m, n, p, rank, size);
+        auto t1 = chrono::high_resolution_clock::now();
 
-    if (rank == 0)
-    {
-        cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
-        assert(C == libcheck(A, B, m, n, p));
+        if (rank == 0)
+        {
+            cout << chrono::duration_cast<chrono::duration<double>>(t1 - t0).count() << endl;
+            assert(max_error(C, libcheck(A, B, m, n, p)) < 1e-10 * n);
+        }
     }
 }
 
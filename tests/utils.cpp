@@ -1,6 +1,7 @@
 #include "matrix.h"
 #include "test_cases.h"
 #include <Eigen/Dense>
+#include <random>
 
 vector<double> libcheck(const vector<double> &A, const vector<double> &B, int m, int n, int p){
     Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
@@ -14,4 +15,23 @@ vector<double> libcheck(const vector<double> &A, const vector<double> &B, int m,
     vector<double> C(m * p);
     memcpy(C.data(), C_eig.data(), sizeof(double) * m * p);
     return C;
-}
\ No newline at end of file
+}
+
+vector<double> random_matrix(int rows, int cols, unsigned seed)
+{
+    mt19937 gen(seed);
+    uniform_real_distribution<double> dist(-1.0, 1.0);
+    vector<double> M((long)rows * cols);
+    for (double &x : M)
+        x = dist(gen);
+    return M;
+}
+
+double max_error(const vector<double> &C, const vector<double> &expected)
+{
+    assert(C.size() == expected.size());
+    double error = 0;
+    for (size_t i = 0; i < C.size(); i++)
+        error = max(error, abs(C[i] - expected[i]));
+    return error;
+}